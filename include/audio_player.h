@@ -5,58 +5,246 @@
 #include <HTTPClient.h>
 #include <WiFiClient.h>
 #include <LittleFS.h>
-#include <vector>
+#include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include "tone_synth.h"
 
+// All playback state is owned by a single task. Public methods post a command
+// to its queue and block until the task reports completion through an event
+// group, so callers never touch I2S or the audio buffer directly. The wait is
+// bounded by SUBMIT_TIMEOUT_MS, so a stalled player cannot hang the network
+// tasks that call in.
 class AudioPlayer {
 public:
+    static constexpr uint32_t SAMPLE_RATE = 22050;
+    static constexpr uint32_t SUBMIT_TIMEOUT_MS = 1000;
+
+    // Outcome of a command. Busy means the player did not finish it within
+    // SUBMIT_TIMEOUT_MS: a command that had not started yet is dropped, one
+    // that had started still completes on its own.
+    enum class Result : uint8_t { Ok, Failed, Busy };
+    // DMA queue used for file and RTP playback (see audio_player.cpp).
+    static constexpr int FILE_DMA_BUF_COUNT = 4;
+    static constexpr int FILE_DMA_BUF_LEN = 256; // frames
+
+    // Part of a clip, in frames from the start of its PCM data.
+    // endFrame == 0 plays to the end of the clip.
+    // The constructor (rather than member initializers) lets PlayRange()
+    // serve as a default argument inside this class.
+    struct PlayRange {
+        PlayRange(uint32_t start = 0, uint32_t end = 0) : startFrame(start), endFrame(end) {}
+        uint32_t startFrame;
+        uint32_t endFrame;
+    };
+
     AudioPlayer(int bck, int ws, int dout, int ampSdPin, bool ampOnState);
 
-    bool playFile(const String &filename);
-    bool playRandom(const char* directory);
-    void stop();
-    void stopStreaming();
+    // Creates the owner task, command queue and event group in static
+    // storage; LittleFS clips are read through two mem_pool blocks.
+    bool begin();
+
+    // Only the requested range is read; cut points get a short ramp.
+    // A non-zero `startAtUs` (epoch microseconds on the clock_sync clock)
+    // loads the clip, arms the output with silence and starts on that sample.
+    Result playFile(const char* filename, const PlayRange &range = PlayRange(), int64_t startAtUs = 0);
+    // Plays a clip from the flash-mapped sound bank without copying it.
+    Result playBank(const char* name, const PlayRange &range = PlayRange(), int64_t startAtUs = 0);
+    // Synthesizes a tone patch block by block; nothing is loaded or stored.
+    Result playTone(const TonePatch& patch, int64_t startAtUs = 0);
+    Result playRandom(const char* directory);
+    // Fades out, flushes the DMA queue and returns once the output is silent.
+    // `latencyUs` receives the measured stop latency.
+    Result stop(uint32_t* latencyUs = nullptr);
     bool isPlaying() const;
+    bool isStreaming() const;
+    // Plays RTP packets arriving on `port` until stopped (see rtp_receiver.h).
+    Result playRtp(uint16_t port);
+    bool isRtpActive() const;
+    // Time from a play command to its first buffer reaching I2S.
+    uint32_t lastStartLatencyUs() const { return _lastStartLatencyUs; }
+    const char* lastSource() const { return _lastSource; }
+    // True while a timed play waits for its start time.
+    bool isArmed() const { return _armed; }
+    // Start of the last timed play minus its requested time, positive
+    // means late. Not measured: it assumes the DMA queue is exactly full
+    // when the padding is written (see pumpArmed()), so it leaves out the
+    // I2S/DAC pipeline and the clock_sync offset error.
+    int32_t estimatedStartSkewUs() const { return _estimatedStartSkewUs; }
+    // Amplifier gating: share of the current (or last) clip's frames played
+    // with the amp powered, and how often it was switched.
+    bool isAmpOn() const { return _ampOn; }
+    uint8_t ampDutyPct() const { return _ampDutyPct; }
+    uint32_t ampSwitches() const { return _ampSwitches; }
+    // Times the DMA queue ran dry mid-clip or mid-stream, since boot.
+    uint32_t underruns() const { return _underruns; }
+    // Commands answered Busy, since boot.
+    uint32_t busyRejects() const { return _busyRejects; }
     void setVolume(float v);
-    // upload-based streaming (called from HTTP upload handler)
-    void streamUploadStart(size_t totalSize);
-    void streamUploadWrite(const uint8_t* buf, size_t len);
-    void streamUploadEnd();
-    void streamUploadAbort();
-    void uninstallI2S();
+    // Gate for background flash writers such as the transcoder: true once
+    // nothing is playing, and no source can start until endFlashWrite().
+    // A start waits for at most the one write in progress.
+    bool beginFlashWrite();
+    void endFlashWrite();
+    // upload-based streaming (called from HTTP upload handler); the player
+    // drops the 44-byte WAV header from the start of the body
+    Result streamUploadStart(size_t totalSize);
+    Result streamUploadWrite(const uint8_t* buf, size_t len);
+    Result streamUploadEnd();
+    Result streamUploadAbort();
 
-    volatile bool stopRequested = false;
 private:
-    static void playTask(void* arg);
-    static void playBufferTask(void* arg);
-    static void directStreamTask(void* arg);
+    static constexpr size_t MAX_PATH_LEN = 64;
+    static constexpr uint32_t TASK_STACK_SIZE = 4096;
+    static constexpr UBaseType_t COMMAND_QUEUE_LEN = 4;
+
+    enum class CommandType : uint8_t {
+        Play,
+        PlayBank,
+        PlayTone,
+        Stop,
+        StreamStart,
+        StreamWrite,
+        StreamEnd,
+        StreamAbort,
+        SetVolume,
+        RtpStart,
+    };
+
+    struct Command {
+        CommandType type;
+        uint32_t seq;            // set by submit()
+        char path[MAX_PATH_LEN];
+        PlayRange range;
+        int64_t startAtUs;
+        const uint8_t* data;     // caller's, held until the command is done
+        size_t len;
+        float volume;
+        uint16_t port;
+        TonePatch tone;
+    };
 
-    bool loadFileToRam(const char* filename);
+    enum class State : uint8_t { Idle, Playing, Streaming, Rtp };
 
-    void installI2S();
+    static void taskEntry(void* arg);
+    void run();
+    Result submit(Command& cmd);
+    bool handleCommand(const Command& cmd);
+
+    bool startPlayback(const char* filename, const PlayRange& range, int64_t startAtUs);
+    bool startBankPlayback(const char* name, const PlayRange& range, int64_t startAtUs);
+    bool startTonePlayback(const TonePatch& patch, int64_t startAtUs);
+    void beginPlayback(uint32_t startedUs, int64_t startAtUs, const char* source, bool attack, bool release);
+    void pumpPlayback();
+    void pumpArmed();
+    void pumpTone();
+    void markStarted(size_t written);
+    bool startStream();
+    bool writeStream(const uint8_t* buf, size_t len);
+    bool startRtp(uint16_t port);
+    void pumpRtp();
+    void endActive(bool fade);
+    void setState(State state);
+
+    bool openFile(const char* filename, const PlayRange& range, bool* attack, bool* release);
+    size_t readBlock(uint8_t* block);
+    bool nextWindow();
+    void refillBack();
+    void freeAudioData();
+
+    void installI2S(bool streaming);
+    void uninstallI2S();
     void startI2S();
     void stopI2S();
-    void resetPlaybackState(bool freeAudio);
-    void stopCurrentPlayback();
     void stopAudioOutput();
-    void startAudioOutput();
+    void startAudioOutput(bool streaming);
+
+    void writeSamples(const uint8_t* data, size_t len, size_t* written, TickType_t timeout);
+    void writeGated(const uint8_t* data, size_t len, size_t* written, TickType_t timeout);
+    void padAmpSettle();
+    void resetGate(size_t queueFrames);
+    void fadeOut(const uint8_t* tail, size_t tailLen);
+    void flushDma();
 
     void setAmplifier(bool enabled);
     void amplifierOn();
     void amplifierOff();
 
-    void finishStream();
-
     int _bck, _ws, _dout, _ampSdPin;
     TaskHandle_t _task = nullptr;
+    QueueHandle_t _queue = nullptr;
+    EventGroupHandle_t _events = nullptr;
+    SemaphoreHandle_t _submitLock = nullptr;
+    SemaphoreHandle_t _flashLock = nullptr;
+    StaticTask_t _taskBuffer;
+    StackType_t _taskStack[TASK_STACK_SIZE];
+    StaticQueue_t _queueBuffer;
+    uint8_t _queueStorage[COMMAND_QUEUE_LEN * sizeof(Command)];
+    StaticEventGroup_t _eventsBuffer;
+    StaticSemaphore_t _submitLockBuffer;
+    StaticSemaphore_t _flashLockBuffer;
+
+    // Command handshake. submit() publishes the sequence number it waits for;
+    // the player task skips a command whose caller has given up and reports
+    // completion by sequence number, so a late result never answers the
+    // next caller.
+    portMUX_TYPE _cmdMux = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t _nextSeq = 0;
+    uint32_t _waitSeq = 0;       // awaited by submit(), 0 if none
+    uint32_t _runSeq = 0;        // being handled by the player task
+    uint32_t _doneSeq = 0;       // last completed
+    bool _doneOk = false;
+    volatile uint32_t _busyRejects = 0;
 
-    uint8_t* _audioData = nullptr;
+    // Owned by the player task.
+    State _state = State::Idle;
+    // The clip (or range) is _audioSize bytes; _audioData holds the part
+    // from _windowStart, _windowLen bytes long. A bank clip is one window.
+    const uint8_t* _audioData = nullptr;
     size_t _audioSize = 0;
+    size_t _windowStart = 0;
+    size_t _windowLen = 0;
+    size_t _playOffset = 0;
+    size_t _attackEnd = 0;       // byte offsets of the cut-point ramps
+    size_t _releaseStart = 0;
+    // A LittleFS clip is double-buffered through two mem_pool blocks: the
+    // front one is played while the back one is refilled from flash.
+    File _file;
+    uint8_t* _fileBlocks[2] = {nullptr, nullptr};
+    uint8_t _frontBlock = 0;
+    size_t _backLen = 0;         // bytes in the back block
+    size_t _fileLeft = 0;        // range bytes not read yet
+    bool _refillPending = false;
+    // Tone playback renders one DMA buffer at a time into _toneBlock.
+    bool _toneActive = false;
+    ToneSynth _tone;
+    int16_t _toneBlock[FILE_DMA_BUF_LEN];
+    size_t _toneBlockLen = 0;    // bytes
+    size_t _toneBlockPos = 0;
+    uint32_t _startRequestedUs = 0;
+    volatile uint32_t _lastStartLatencyUs = 0;
+    const char* volatile _lastSource = "none";
+    // Timed start, in esp_timer microseconds; silence is fed until then.
+    int64_t _startAtTimerUs = 0;
+    size_t _armFrames = 0;       // silence written while armed
+    volatile bool _armed = false;
+    volatile int32_t _estimatedStartSkewUs = 0;
 
     float _volume = 1.0f;
-    bool _OnState = 1; // 1 - on when HIGH, 0 - on when LOW  
+    bool _OnState = 1; // 1 - on when HIGH, 0 - on when LOW
     bool _i2sInstalled = false;
-    bool _isStreaming = false;
-    bool _shouldFreeAudioData = false;
+    volatile bool _ampOn = false;
+    // Amplifier gating, per clip or stream
+    size_t _gateQueueFrames = 0;   // DMA queue depth: delay between write and output
+    size_t _silentRunFrames = 0;   // silent frames written since the last audible one
+    uint64_t _gateFramesTotal = 0;
+    uint64_t _gateFramesOn = 0;
+    volatile uint8_t _ampDutyPct = 0;
+    volatile uint32_t _ampSwitches = 0;
+    int64_t _queueEndUs = 0;       // estimated time the written audio runs out
+    volatile uint32_t _underruns = 0;
+    int16_t _lastSample = 0;
+    size_t _flushFrames = 0;
     // upload streaming state
     bool _uploadHeaderSkipped = false;
     size_t _uploadHeaderBytes = 0;
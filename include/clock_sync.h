@@ -0,0 +1,47 @@
+#pragma once
+#include <IPAddress.h>
+#include <stdint.h>
+
+// Wall clock for synchronised playback. Starts from the NTP time that setup()
+// establishes and can be pulled closer to a reference node with an NTP-style
+// four-timestamp exchange over UDP, keeping the sample with the lowest round
+// trip. Every node answers probes on CLOCK_SYNC_PORT; nodes that should follow
+// a reference are pointed at it with /clock/sync?peer=<ip>.
+
+#define CLOCK_SYNC_PORT         5005
+#define CLOCK_SYNC_SAMPLES      8
+#define CLOCK_SYNC_TIMEOUT_MS   250
+#define CLOCK_SYNC_INTERVAL_MS  (10 * 60 * 1000UL) // re-measure the reference peer
+#define PLAY_AT_MAX_LEAD_MS     60000 // furthest accepted /play?at= in the future
+
+struct ClockSyncResult {
+    bool valid;
+    int64_t offset_us;   // reference clock minus local clock
+    uint32_t rtt_us;     // round trip of the best sample
+    uint8_t samples;     // answered probes
+};
+
+// Also starts the task that measures and periodically re-measures the
+// reference.
+void clock_sync_init();
+
+// Local epoch time in microseconds, corrected by the peer offset if set.
+int64_t clock_sync_now_us();
+bool clock_sync_time_valid();
+// Converts a requested start time in epoch milliseconds to the microseconds
+// AudioPlayer expects. Fails if the clock is unset or the time is already
+// past or more than PLAY_AT_MAX_LEAD_MS away.
+bool clock_sync_start_time(uint64_t epochMs, int64_t* startAtUs);
+
+// Queues a measurement against `peer` and returns at once; the exchange
+// takes up to CLOCK_SYNC_SAMPLES * CLOCK_SYNC_TIMEOUT_MS. If the peer
+// answers, the node follows it from then on; otherwise the previous
+// reference stays. Poll clock_sync_measuring() for the outcome.
+bool clock_sync_request(const IPAddress& peer);
+bool clock_sync_measuring();
+// The last measurement got no usable reply.
+bool clock_sync_last_failed();
+void clock_sync_clear_reference();
+// The measurement currently applied.
+ClockSyncResult clock_sync_last_result();
+IPAddress clock_sync_reference();
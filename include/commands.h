@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+#include "audio_player.h"
+
+// Command execution behind /batch and /ws (see control.h). Kept apart from
+// the web server so the host tools in tools/ can run batches directly.
+
+void commands_init(AudioPlayer& player);
+
+// Parses a JSON command array and executes it in order. Returns the HTTP
+// status; the reply, or the error text, is written to `out`. Called on the
+// AsyncTCP task only, one batch at a time.
+int commands_run_batch(const char* body, size_t len, char* out, size_t outLen);
+
+// Single triggers shared with the binary /ws frames. `name` is a file name
+// (leading '/' optional), a sprite name or a tone name without .tone.
+AudioPlayer::Result commands_play_file(const char* name, const AudioPlayer::PlayRange& range, int64_t startAtUs = 0);
+AudioPlayer::Result commands_play_sprite(const char* name, int64_t startAtUs = 0);
+AudioPlayer::Result commands_play_tone(const char* name, int64_t startAtUs = 0);
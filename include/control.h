@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include "audio_player.h"
+
+// Low-overhead control plane on top of the plain HTTP endpoints:
+//
+//   POST /batch  JSON array of commands executed in order, one JSON reply:
+//                [{"cmd":"stop"},{"cmd":"play","file":"a.wav"},{"cmd":"battery"}]
+//                -> {"results":[{"cmd":"stop","ok":true,"data":{...}}, ...]}
+//
+//   /ws          persistent WebSocket. Text frames carry the same JSON array
+//                as /batch. Binary frames are single triggers:
+//                  request  [op][seq][payload...]
+//                  response [op][seq][status][u16 value, little-endian]
+//                status is a ControlStatus; value is the stop latency in ms
+//                for CONTROL_OP_STOP and 0 otherwise. A command the player
+//                did not take within AudioPlayer::SUBMIT_TIMEOUT_MS reports
+//                CONTROL_STATUS_BUSY (in JSON: "ok":false,"error":"busy").
+//                After a Busy, or once a batch has run for
+//                CONTROL_BATCH_DEADLINE_MS, its remaining commands are not
+//                run and report "ok":false,"error":"skipped".
+//
+//   POST /tone   a tone patch (see tones.h), synthesized and played at once;
+//                optional ?at= as for /play.
+//
+// Commands: ping, play (file|bank|sprite|tone, start, end, unit, at), play_random,
+// stop, volume (value 0..1), status, battery, sleep.
+
+enum ControlOp : uint8_t {
+    CONTROL_OP_PING        = 0x01,
+    CONTROL_OP_PLAY_FILE   = 0x02, // payload: file name
+    CONTROL_OP_PLAY_BANK   = 0x03, // payload: bank clip name
+    CONTROL_OP_PLAY_SPRITE = 0x04, // payload: sprite name
+    CONTROL_OP_PLAY_RANDOM = 0x05,
+    CONTROL_OP_STOP        = 0x06,
+    CONTROL_OP_VOLUME      = 0x07, // payload: u8, 0..255
+    CONTROL_OP_PLAY_TONE   = 0x08, // payload: tone file name, without .tone
+};
+
+enum ControlStatus : uint8_t {
+    CONTROL_STATUS_OK     = 0,
+    CONTROL_STATUS_FAILED = 1,
+    CONTROL_STATUS_BUSY   = 2,
+};
+
+#define CONTROL_BATCH_MAX_BODY     2048
+#define CONTROL_BATCH_MAX_COMMANDS 16
+#define CONTROL_BATCH_DEADLINE_MS  1000 // no command starts later; one may still wait SUBMIT_TIMEOUT_MS
+#define CONTROL_BATCH_MAX_NESTING  5    // array, command, inline tone, notes, note
+#define CONTROL_BATCH_JSON_ARENA   8192 // parsed /batch and /ws documents; no heap
+#define CONTROL_BATCH_MAX_RESPONSE 2048
+#define CONTROL_STATUS_JSON_LEN    512
+
+void control_init(AsyncWebServer& server, AudioPlayer& player);
+void control_handle();
+
+// JSON bodies shared by the GET endpoints and batch results.
+size_t control_battery_json(char* out, size_t len);
+size_t control_sleep_json(char* out, size_t len);
+size_t control_status_json(char* out, size_t len);
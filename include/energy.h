@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Energy ledger. Time spent in each power state, amplifier energy, deep
+// sleeps and resets are accumulated into a fixed-size ledger in RTC memory,
+// which survives deep sleep and soft resets, and copied to NVS every
+// ENERGY_FLUSH_INTERVAL_MS, deferred while audio is playing, so a power loss
+// costs at most one interval plus the clip or session in progress. NVS
+// writes rotate over ENERGY_NVS_SLOTS keys; the newest valid copy wins.
+//
+// Counters are rolled up per local day (ENERGY_DAYS kept) next to battery
+// voltage samples, and /energy turns them into average power and a runtime
+// estimate using the power model from config.h.
+
+#define ENERGY_DAYS      7
+#define ENERGY_NVS_SLOTS 4
+
+// Power states that can overlap; being awake is implied.
+enum EnergyFlag : uint8_t {
+    ENERGY_WIFI_UP = 1 << 0, // associated; otherwise connecting or backing off
+    ENERGY_I2S     = 1 << 1, // I2S driver installed
+    ENERGY_AMP     = 1 << 2, // amplifier powered
+};
+
+enum class EnergySleep : uint8_t {
+    None,
+    Night,    // sleep_go_until_wakeup()
+    Battery,  // battery_check_critical()
+};
+
+// Call after battery_init() and before anything can enter deep sleep.
+void energy_init();
+void energy_handle();
+
+// Safe from any task and before energy_init().
+void energy_set(EnergyFlag flag, bool on);
+// Amplifier output while powered: `frames` at the player rate with the
+// given mean square sample value.
+void energy_add_amp(uint32_t frames, uint64_t meanSquare);
+
+// Closes the awake period just before esp_deep_sleep_start().
+void energy_before_sleep(EnergySleep reason);
+
+// Writes the /energy document; returns the length, 0 if it did not fit.
+size_t energy_json(char* out, size_t len);
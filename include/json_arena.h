@@ -0,0 +1,66 @@
+#pragma once
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ArduinoJson allocator over a fixed buffer, so parsing never touches the
+// heap. Allocation bumps an offset and nothing is freed until the arena goes
+// out of scope; declare it before the JsonDocument that uses it. When the
+// buffer is full allocate() returns nullptr and deserializeJson() reports
+// NoMemory.
+//
+// Each block is preceded by its size, so reallocate() can grow or shrink the
+// newest block (a string being built) in place and copy any other.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    static constexpr size_t ALIGN = 8;
+
+    JsonArena(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap) {}
+
+    void* allocate(size_t size) override {
+        size_t start = (_used + sizeof(size_t) + ALIGN - 1) & ~(ALIGN - 1);
+        if (start > _cap || size > _cap - start) {
+            _overflowed = true;
+            return nullptr;
+        }
+        setSize(start, size);
+        _last = start;
+        _used = start + size;
+        return _buf + start;
+    }
+
+    void deallocate(void*) override {}
+
+    void* reallocate(void* ptr, size_t size) override {
+        if (!ptr) return allocate(size);
+
+        size_t start = (uint8_t*)ptr - _buf;
+        if (start == _last && size <= _cap - start) {
+            setSize(start, size);
+            _used = start + size;
+            return ptr;
+        }
+
+        size_t old;
+        memcpy(&old, _buf + start - sizeof(size_t), sizeof(old));
+        if (size <= old) return ptr;
+        void* moved = allocate(size);
+        if (moved) memcpy(moved, ptr, old);
+        return moved;
+    }
+
+    bool overflowed() const { return _overflowed; }
+    size_t used() const { return _used; }
+
+private:
+    void setSize(size_t start, size_t size) {
+        memcpy(_buf + start - sizeof(size_t), &size, sizeof(size));
+    }
+
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _used = 0;
+    size_t _last = 0;
+    bool _overflowed = false;
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Appends formatted text to a fixed buffer. Output that does not fit is
+// dropped and flagged instead of growing the buffer.
+struct JsonOut {
+    char* buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+
+    void add(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (overflow) return;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf + len, cap - len, fmt, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= cap - len) {
+            overflow = true;
+            buf[len] = '\0';
+            return;
+        }
+        len += n;
+    }
+};
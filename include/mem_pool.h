@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Boot-time memory for everything that used to be allocated per request.
+// One DMA-capable arena is reserved in setup(), before Wi-Fi fragments the
+// heap, and carved into MEM_BLOCK_COUNT fixed blocks. They hold request
+// bodies such as /batch and, two at a time, the double buffer that LittleFS
+// clips are read through while they play, so clip length is not limited by
+// RAM. Batches and tone patches parse into fixed arenas and sprites are
+// cached at boot; after init the heap is only used by LittleFS.open() (one
+// file handle per clip or tone opened) and by the web server's own request
+// and response objects.
+
+#define MEM_BLOCK_SIZE   2048        // >= CONTROL_BATCH_MAX_BODY; ~46 ms of audio
+#define MEM_BLOCK_COUNT  6           // one playback pair + four request bodies
+
+struct MemStats {
+    bool arena_ok;
+    uint32_t heap_free;
+    uint32_t heap_min_free;       // low-water mark since boot
+    uint32_t heap_largest_block;
+    uint8_t fragmentation_pct;    // 100 - largest block / free
+    uint32_t play_rejects;        // LittleFS plays refused, no block pair free
+    uint8_t blocks_in_use;
+    uint8_t blocks_peak;
+    uint32_t block_failures;      // allocations refused, pool empty
+};
+
+bool mem_pool_init();
+
+// At most MEM_BLOCK_COUNT - 2 at a time, so a play always finds its pair.
+void* mem_block_alloc();
+// Two blocks or none, for the player's double buffer. Free each with
+// mem_block_free().
+bool mem_block_alloc_pair(void** first, void** second);
+void mem_block_free(void* block);
+
+MemStats mem_get_stats();
@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Connectionless audio input: RTP-style packets over UDP, reordered in a small
+// jitter buffer and played through the same I2S writer as /stream.
+//
+// Packet: 12-byte RTP header (version 2, payload type RTP_PAYLOAD_TYPE,
+// sequence number, timestamp, SSRC; no CSRC list or extensions) followed by
+// up to RTP_MAX_FRAMES of 16-bit little-endian mono PCM at 22050 Hz.
+// tools/rtp_send.py is a reference sender.
+
+#define RTP_DEFAULT_PORT       5004
+#define RTP_PAYLOAD_TYPE       96
+#define RTP_MAX_FRAMES         256  // per packet, ~11.6 ms
+#define RTP_JITTER_SLOTS       16   // must be a power of two
+#define RTP_PREBUFFER_PACKETS  4    // ~46 ms before playout starts
+#define RTP_CONCEAL_PACKETS    4    // repeat with decay, then silence
+#define RTP_UNDERRUN_PACKETS   32   // missing this many in a row -> re-prebuffer
+
+struct RtpStats {
+    uint16_t port;
+    bool listening;
+    bool playing;           // false while prebuffering
+    uint32_t received;
+    uint32_t played;
+    uint32_t concealed;     // packets replaced by repetition or silence
+    uint32_t late;          // arrived after their playout slot
+    uint32_t reordered;     // arrived out of order but in time
+    uint32_t duplicates;
+    uint32_t malformed;
+    uint32_t buffered;      // packets currently waiting
+    uint32_t jitter_us;     // RFC 3550 interarrival jitter estimate
+};
+
+enum class RtpPull : uint8_t {
+    Packet,      // `out` holds received audio
+    Concealed,   // `out` holds a repeated/decayed packet or silence
+    Buffering,   // nothing to play yet; `out` holds silence
+};
+
+bool rtp_receiver_begin(uint16_t port);
+void rtp_receiver_end();
+bool rtp_receiver_listening();
+
+// Called by the player task once per packet period. `out` must hold
+// RTP_MAX_FRAMES frames; `frames` receives the number filled.
+RtpPull rtp_receiver_pull(int16_t* out, size_t* frames);
+
+RtpStats rtp_receiver_stats();
@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed PCM clips stored in the raw "soundbank" flash partition and read
+// through a memory mapping. Build and flash the image with
+// `pio run -t uploadbank` (see tools/build_soundbank.py for the layout).
+
+struct SoundBankClip {
+    const char* name;
+    const uint8_t* data;   // flash-mapped, read-only
+    size_t size;           // bytes of 16-bit mono PCM
+};
+
+bool sound_bank_init();
+bool sound_bank_available();
+size_t sound_bank_count();
+bool sound_bank_get(size_t index, SoundBankClip* clip);
+bool sound_bank_find(const char* name, SoundBankClip* clip);
@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+#include "audio_player.h"
+
+// Named segments of longer recordings, defined in /sprites.json:
+//
+//   {
+//     "chirp": { "file": "dawn_chorus.wav", "start_ms": 1200, "end_ms": 1850 },
+//     "knock": { "bank": "door.wav", "start": 4410, "end": 8820 }
+//   }
+//
+// "file" refers to LittleFS, "bank" to the flash sound bank. Offsets are
+// given either in milliseconds (start_ms/end_ms) or in samples (start/end);
+// a missing end plays to the end of the clip.
+//
+// The manifest is read once by sprites_init() at boot into a fixed table of
+// SPRITE_MAX entries, so a lookup touches neither flash nor the heap. Changes
+// to /sprites.json take effect after a reboot.
+
+#define SPRITE_MANIFEST_PATH "/sprites.json"
+#define SPRITE_PATH_LEN 64
+#define SPRITE_NAME_LEN 32
+#define SPRITE_MAX 32
+
+struct Sprite {
+    char file[SPRITE_PATH_LEN];  // LittleFS path with leading '/', empty for bank sprites
+    char bank[SPRITE_PATH_LEN];  // sound bank clip name, empty for file sprites
+    AudioPlayer::PlayRange range;
+};
+
+// Returns the number of sprites loaded.
+size_t sprites_init();
+bool sprite_lookup(const char* name, Sprite* sprite);
+uint32_t sprite_ms_to_frames(uint32_t ms);
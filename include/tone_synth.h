@@ -0,0 +1,82 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Procedural tones for chimes and beeps. A patch is one wavetable voice with
+// an ADSR envelope, played over a sequence of notes; it is a few hundred
+// bytes instead of a WAV in LittleFS and two pool blocks to play it.
+//
+// The per-sample path is integer only: a 32-bit phase accumulator indexes a
+// 256-entry table with linear interpolation, and the envelope is a linear
+// ramp stepped once per sample. Floating point is used once per note.
+//
+// No Arduino dependencies, so the engine also builds on the host
+// (tools/bench_tone.cpp).
+
+#define TONE_MAX_NOTES 16
+
+enum class ToneWave : uint8_t {
+    Sine,
+    Triangle,
+    Square,   // 8 odd harmonics: alias-free up to ~700 Hz
+    Saw,      // 16 harmonics: alias-free up to ~690 Hz
+};
+
+struct ToneNote {
+    float hz;          // 0 = rest
+    uint16_t ms;
+    uint8_t level;     // 0..255, scaled by the patch gain
+};
+
+struct TonePatch {
+    ToneWave wave = ToneWave::Sine;
+    uint8_t gain = 128;          // 0..255 of full scale
+    uint16_t attack_ms = 5;
+    uint16_t decay_ms = 50;
+    uint8_t sustain = 160;       // 0..255 of the note level
+    uint16_t release_ms = 80;    // taken from the end of each note, at most half of it
+    uint8_t count = 0;
+    ToneNote notes[TONE_MAX_NOTES];
+};
+
+// Builds the wavetables. Called by AudioPlayer::begin(); start() calls it
+// too if needed.
+void tone_synth_init();
+
+class ToneSynth {
+public:
+    // Returns false for an empty patch.
+    bool start(const TonePatch& patch, uint32_t sampleRate);
+    // Renders up to `frames` mono samples. Returns the number written, which
+    // is less than `frames` only at the end of the patch (0 once done).
+    size_t render(int16_t* out, size_t frames);
+    bool done() const { return _note >= _patch.count; }
+    uint32_t totalFrames() const { return _totalFrames; }
+
+private:
+    enum class Stage : uint8_t { Attack, Decay, Sustain, Release };
+
+    uint32_t msToFrames(uint32_t ms) const;
+    void beginNote();
+    void enterStage(Stage stage);
+    void nextStage();
+
+    TonePatch _patch;
+    uint32_t _rate = 0;
+    uint32_t _totalFrames = 0;
+    const int16_t* _table = nullptr;
+
+    uint8_t _note = 0;
+    uint32_t _noteFrame = 0;     // position within the note
+    uint32_t _noteFrames = 0;
+    uint32_t _gateFrames = 0;    // release starts here
+    uint32_t _phase = 0;
+    uint32_t _step = 0;          // phase increment per sample
+    int32_t _amp = 0;            // note level x gain, 0..255
+
+    Stage _stage = Stage::Attack;
+    uint32_t _stageLeft = 0;
+    int32_t _env = 0;            // Q30
+    int32_t _envStep = 0;
+    int32_t _envTarget = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "tone_synth.h"
+
+// Tone patches in JSON, posted to /tone or stored in LittleFS as
+// /<name>.tone and played with /play?tone=<name>:
+//
+//   {
+//     "wave": "sine",              sine | triangle | square | saw
+//     "gain": 0.5,                 0..1
+//     "adsr": [5, 80, 0.6, 120],   attack ms, decay ms, sustain 0..1, release ms
+//     "notes": [["E6", 150], ["C6", 400, 0.8], [0, 100], [880, 120]]
+//   }
+//
+// A note is [pitch, ms] or [pitch, ms, level 0..1]. Pitch is a frequency in
+// Hz, a note name such as "A4" or "C#5", or 0 / "r" for a rest. Missing
+// fields keep the TonePatch defaults.
+
+#define TONE_FILE_EXT ".tone"
+#define TONE_FILE_MAX_BYTES 1024
+#define TONE_JSON_ARENA 4096 // parsed patch; larger ones are refused, not parsed on the heap
+
+// Returns false and sets `error` (static text) if the patch is invalid.
+bool tone_parse(JsonVariantConst doc, TonePatch* patch, const char** error);
+bool tone_parse_json(const char* json, size_t len, TonePatch* patch, const char** error);
+// Loads /<name>.tone.
+bool tone_load(const char* name, TonePatch* patch, const char** error);
@@ -0,0 +1,60 @@
+#pragma once
+#include <Arduino.h>
+#include "audio_player.h"
+
+// Background conversion of stored WAV files into the player's native format:
+// AudioPlayer::SAMPLE_RATE, mono, 16-bit PCM, loudness-normalized, with
+// leading and trailing silence trimmed.
+//
+// A low-priority task works through a small job queue in two streaming
+// passes over fixed buffers: the first measures level and silence, the
+// second writes <dst>.tmp, which is then renamed over <dst> (LittleFS
+// renames atomically). The task waits while the player is busy, and each
+// flash write holds AudioPlayer::beginFlashWrite(), so no write overlaps
+// playback.
+//
+// Jobs come from POST /jobs and, with TRANSCODE_SCAN_ON_BOOT, from a scan of
+// the root directory for files uploaded in another format. Nothing else
+// queues them; there is no conversion after an upload.
+
+#define TRANSCODE_MAX_JOBS     8
+#define TRANSCODE_PATH_LEN     64
+#define TRANSCODE_TARGET_DBFS  -18  // gated RMS after normalization
+#define TRANSCODE_MAX_GAIN_DB  20
+
+enum class JobState : uint8_t {
+    Queued,
+    Analyzing,   // pass 1
+    Converting,  // pass 2
+    Done,
+    Failed,
+};
+
+struct TranscodeJob {
+    uint16_t id;                      // 0 = free slot
+    JobState state;
+    uint8_t progress_pct;
+    char src[TRANSCODE_PATH_LEN];
+    char dst[TRANSCODE_PATH_LEN];
+    // Source format, known after the header is read
+    uint32_t in_rate;
+    uint8_t in_channels;
+    uint8_t in_bits;
+    bool in_float;
+    uint32_t out_frames;
+    float gain_db;
+    uint32_t trimmed_ms;              // leading + trailing silence removed
+    uint32_t elapsed_ms;
+    uint32_t yielded_ms;              // spent waiting for playback to finish
+    const char* error;                // static text, set when Failed
+};
+
+void transcoder_init(AudioPlayer& player);
+
+// Queues a conversion of `src` into `dst` (the same path to replace it).
+// Returns the job id, 0 if the queue is full.
+uint16_t transcoder_enqueue(const char* src, const char* dst);
+
+const char* transcoder_state_name(JobState state);
+// Writes the /jobs document; returns the length, 0 if it did not fit.
+size_t transcoder_jobs_json(char* out, size_t len);
@@ -1,5 +1,35 @@
 #pragma once
 #include <WiFi.h>
 
+// Event-driven station connection. wifi_init() returns immediately; a lost
+// link is retried with exponential backoff, first directly on the last
+// BSSID/channel and then with a full scan. The HTTP server stays bound the
+// whole time, and the node reboots only after WIFI_REBOOT_BUDGET_MS without
+// a connection.
+
+enum class WifiState : uint8_t {
+    Connecting,   // attempt in progress
+    Connected,    // associated and has an IP
+    Backoff,      // waiting before the next attempt
+};
+
+struct WifiStats {
+    WifiState state;
+    uint32_t disconnects;        // links lost after being connected
+    uint32_t reconnects;         // links restored after a loss
+    uint32_t attempts;           // attempts in the current (or last) outage
+    uint32_t fast_attempts;      // of those, direct to the saved BSSID
+    uint8_t last_reason;         // wifi_err_reason_t of the last disconnect
+    uint32_t boot_connect_ms;    // wifi_init() to first IP
+    uint32_t last_reconnect_ms;  // outage length of the last reconnect
+    uint32_t max_reconnect_ms;
+    uint32_t down_ms;            // current outage, 0 while connected
+    uint32_t next_attempt_ms;    // 0 unless backing off
+};
+
 void wifi_init();
+// Waits up to `timeoutMs` for the first connection; never reboots.
+bool wifi_wait_connected(uint32_t timeoutMs);
 bool wifi_is_connected();
+WifiStats wifi_get_stats();
+const char* wifi_state_name(WifiState state);
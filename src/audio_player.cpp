@@ -1,4 +1,63 @@
 #include "audio_player.h"
+#include "sound_bank.h"
+#include "rtp_receiver.h"
+#include "clock_sync.h"
+#include "mem_pool.h"
+#include "energy.h"
+#include <esp_timer.h>
+
+static constexpr uint32_t SAMPLE_RATE = AudioPlayer::SAMPLE_RATE;
+static constexpr size_t WAV_HEADER_SIZE = 44;
+static constexpr size_t BYTES_PER_FRAME = sizeof(int16_t);
+
+// File playback reads from RAM, so a shallow DMA queue is enough and keeps
+// stop latency low. Uploads arrive over Wi-Fi and need a deeper queue to ride
+// out network jitter.
+static constexpr int FILE_DMA_BUF_COUNT = AudioPlayer::FILE_DMA_BUF_COUNT;
+static constexpr int FILE_DMA_BUF_LEN = AudioPlayer::FILE_DMA_BUF_LEN;
+static constexpr int STREAM_DMA_BUF_COUNT = 8;
+static constexpr int STREAM_DMA_BUF_LEN = 512; // frames
+
+// i2s_write timeout of roughly one file DMA buffer, so the player task gets
+// back to its command queue within a single buffer period.
+static constexpr TickType_t WRITE_TIMEOUT_TICKS =
+    pdMS_TO_TICKS(FILE_DMA_BUF_LEN * 1000 / SAMPLE_RATE + 1);
+static constexpr TickType_t STREAM_WRITE_TIMEOUT_TICKS = pdMS_TO_TICKS(100);
+static constexpr TickType_t FLUSH_TIMEOUT_TICKS = pdMS_TO_TICKS(1000);
+
+static constexpr uint32_t FADE_OUT_MS = 5;
+static constexpr size_t FADE_OUT_FRAMES = SAMPLE_RATE * FADE_OUT_MS / 1000;
+
+// Attack/release applied where a range cuts into the middle of a clip.
+static constexpr uint32_t CUT_RAMP_MS = 3;
+static constexpr size_t CUT_RAMP_FRAMES = SAMPLE_RATE * CUT_RAMP_MS / 1000;
+
+// Amplifier gating. A block whose RMS is below AMP_SILENCE_RMS counts as
+// silent; once AMP_OFF_HOLD_MS of silence has played out past the DMA queue
+// the amp is powered down. It comes back when a block reaches AMP_WAKE_RMS,
+// with at least AMP_SETTLE_MS of silence queued ahead of that block so the
+// amp's turn-on transient settles before the audio reaches it.
+static constexpr uint32_t AMP_SILENCE_RMS = 16;  // ~-66 dBFS
+static constexpr uint32_t AMP_WAKE_RMS = 32;     // level hysteresis
+static constexpr uint32_t AMP_OFF_HOLD_MS = 250; // time hysteresis
+static constexpr size_t AMP_OFF_HOLD_FRAMES = SAMPLE_RATE * AMP_OFF_HOLD_MS / 1000;
+static constexpr uint32_t AMP_SETTLE_MS = 20;    // the old fixed delay before enabling
+static constexpr int64_t AMP_SETTLE_US = AMP_SETTLE_MS * 1000LL;
+
+// Timed starts: once the DMA queue is full, audio written now starts this
+// long from now.
+static constexpr int64_t DMA_QUEUE_US = (int64_t)FILE_DMA_BUF_COUNT * FILE_DMA_BUF_LEN * 1000000LL / SAMPLE_RATE;
+static constexpr int64_t DMA_BUF_US = (int64_t)FILE_DMA_BUF_LEN * 1000000LL / SAMPLE_RATE;
+
+// A running stream write holds the caller's buffer; submit() polls at this
+// interval until it is released.
+static constexpr TickType_t STREAM_HOLD_POLL_TICKS = pdMS_TO_TICKS(10);
+
+// Event group bits
+static constexpr EventBits_t EVT_CMD_DONE  = BIT0; // owner finished a command, see _doneSeq
+static constexpr EventBits_t EVT_PLAYING   = BIT1;
+static constexpr EventBits_t EVT_STREAMING = BIT2;
+static constexpr EventBits_t EVT_RTP       = BIT3;
 
 AudioPlayer::AudioPlayer(int bck, int ws, int dout, int ampSdPin, bool ampOnState)
     : _bck(bck), _ws(ws), _dout(dout), _ampSdPin(ampSdPin), _OnState(ampOnState) {
@@ -6,18 +65,47 @@ AudioPlayer::AudioPlayer(int bck, int ws, int dout, int ampSdPin, bool ampOnStat
     amplifierOff();
 }
 
-void AudioPlayer::installI2S() {
+bool AudioPlayer::begin() {
+    if (_task) return true;
+
+    _queue = xQueueCreateStatic(COMMAND_QUEUE_LEN, sizeof(Command), _queueStorage, &_queueBuffer);
+    _events = xEventGroupCreateStatic(&_eventsBuffer);
+    _submitLock = xSemaphoreCreateMutexStatic(&_submitLockBuffer);
+    _flashLock = xSemaphoreCreateMutexStatic(&_flashLockBuffer);
+    if (!_queue || !_events || !_submitLock || !_flashLock) {
+        Serial.println("AudioPlayer: failed to create sync primitives");
+        return false;
+    }
+
+    tone_synth_init(); // builds the wavetables once, off the playback path
+
+    _task = xTaskCreateStatic(taskEntry, "AudioPlay", TASK_STACK_SIZE, this, 2, _taskStack, &_taskBuffer);
+    if (!_task) {
+        Serial.println("AudioPlayer: failed to create task");
+        return false;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// I2S / amplifier
+// -----------------------------------------------------------------------------
+
+void AudioPlayer::installI2S(bool streaming) {
     if (_i2sInstalled) return;
 
+    int bufCount = streaming ? STREAM_DMA_BUF_COUNT : FILE_DMA_BUF_COUNT;
+    int bufLen = streaming ? STREAM_DMA_BUF_LEN : FILE_DMA_BUF_LEN;
+
     i2s_config_t cfg = {
         .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
-        .sample_rate = 22050,
+        .sample_rate = SAMPLE_RATE,
         .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
         .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
         .communication_format = I2S_COMM_FORMAT_I2S_MSB,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 512,
+        .dma_buf_count = bufCount,
+        .dma_buf_len = bufLen,
         .use_apll = false,
         .tx_desc_auto_clear = true
     };
@@ -31,10 +119,14 @@ void AudioPlayer::installI2S() {
 
     esp_err_t err1 = i2s_driver_install(I2S_NUM_0, &cfg, 0, nullptr);
     esp_err_t err2 = i2s_set_pin(I2S_NUM_0, &pins);
-    
+
     Serial.printf("I2S install result: %d, pin result: %d\n", err1, err2);
 
+    // One extra buffer covers the descriptor that is mid-transfer.
+    _flushFrames = (size_t)(bufCount + 1) * bufLen;
+    _lastSample = 0;
     _i2sInstalled = true;
+    energy_set(ENERGY_I2S, true);
 }
 
 void AudioPlayer::uninstallI2S() {
@@ -45,6 +137,7 @@ void AudioPlayer::uninstallI2S() {
     i2s_driver_uninstall(I2S_NUM_0);
 
     _i2sInstalled = false;
+    energy_set(ENERGY_I2S, false);
 }
 
 void AudioPlayer::startI2S() {
@@ -65,6 +158,8 @@ void AudioPlayer::setAmplifier(bool enabled) {
         (gpio_num_t)_ampSdPin,
         enabled ? (_OnState ? 1 : 0) : (_OnState ? 0 : 1)
     );
+    _ampOn = enabled;
+    energy_set(ENERGY_AMP, enabled);
     Serial.printf("Amplifier %s (pin %d)\n",
                   enabled ? "enabled" : "disabled",
                   _ampSdPin);
@@ -73,11 +168,14 @@ void AudioPlayer::setAmplifier(bool enabled) {
 void AudioPlayer::amplifierOn()  { setAmplifier(true); }
 void AudioPlayer::amplifierOff() { setAmplifier(false); }
 
-void AudioPlayer::startAudioOutput() {
-    installI2S();
+// The amp stays off until the first audible block; writeGated() powers it.
+// The delay lets the I2S clocks settle before anything is queued.
+void AudioPlayer::startAudioOutput(bool streaming) {
+    installI2S(streaming);
     startI2S();
     vTaskDelay(pdMS_TO_TICKS(20));
-    amplifierOn();
+    resetGate(streaming ? STREAM_DMA_BUF_COUNT * STREAM_DMA_BUF_LEN
+                        : FILE_DMA_BUF_COUNT * FILE_DMA_BUF_LEN);
 }
 
 void AudioPlayer::stopAudioOutput() {
@@ -86,250 +184,898 @@ void AudioPlayer::stopAudioOutput() {
     uninstallI2S();
 }
 
-void AudioPlayer::resetPlaybackState(bool freeAudio) {
-    stopAudioOutput();
-
-    _isStreaming = false;
-    stopRequested = false;
-
-    if (freeAudio && _audioData && _shouldFreeAudioData) {
-        heap_caps_free(_audioData);
-        _audioData = nullptr;
-        _audioSize = 0;
-        _shouldFreeAudioData = false;
+void AudioPlayer::writeSamples(const uint8_t* data, size_t len, size_t* written, TickType_t timeout) {
+    *written = 0;
+    esp_err_t res = i2s_write(I2S_NUM_0, data, len, written, timeout);
+    if (res != ESP_OK) {
+        Serial.printf("i2s_write error: %d\n", res);
+    }
+    if (*written >= sizeof(int16_t)) {
+        memcpy(&_lastSample, data + (*written & ~(size_t)1) - sizeof(int16_t), sizeof(int16_t));
     }
 }
 
-void AudioPlayer::stopCurrentPlayback() {
-    stopRequested = true;
+void AudioPlayer::resetGate(size_t queueFrames) {
+    _gateQueueFrames = queueFrames;
+    _silentRunFrames = 0;
+    _gateFramesTotal = 0;
+    _gateFramesOn = 0;
+    _ampDutyPct = 0;
+    _ampSwitches = 0;
+    _queueEndUs = 0;
+}
 
-    if (_isStreaming) {
-        stopStreaming();
+// writeSamples() for programme audio, with amplifier gating.
+void AudioPlayer::writeGated(const uint8_t* data, size_t len, size_t* written, TickType_t timeout) {
+    size_t frames = len / BYTES_PER_FRAME;
+    uint64_t sumSquares = 0;
+    for (size_t i = 0; i < frames; i++) {
+        int16_t sample;
+        memcpy(&sample, data + i * BYTES_PER_FRAME, sizeof(sample));
+        sumSquares += (int32_t)sample * sample;
     }
+    uint64_t meanSquare = frames ? sumSquares / frames : 0;
+    uint32_t threshold = _ampOn ? AMP_SILENCE_RMS : AMP_WAKE_RMS;
+    bool silent = meanSquare < (uint64_t)threshold * threshold;
 
-    while (_task) {
-        vTaskDelay(pdMS_TO_TICKS(10));
+    if (!silent && !_ampOn) {
+        amplifierOn();
+        _ampSwitches++;
+        padAmpSettle();
     }
-}
 
-bool AudioPlayer::loadFileToRam(const char* filename) {
-    File f = LittleFS.open(filename, "r");
-    if (!f) {
-        Serial.printf("Cannot open file: %s\n", filename);
-        return false;
+    // Underrun check: if the written audio should already have run out, the
+    // DMA has been playing auto-cleared silence. A write that had to block
+    // leaves the queue full, which re-anchors the estimate to the real
+    // output clock.
+    int64_t before = esp_timer_get_time();
+    if (_queueEndUs && before > _queueEndUs) _underruns++;
+
+    writeSamples(data, len, written, timeout);
+    size_t done = *written / BYTES_PER_FRAME;
+
+    int64_t after = esp_timer_get_time();
+    int64_t queueUs = (int64_t)_gateQueueFrames * 1000000LL / SAMPLE_RATE;
+    if (after - before > 1000) {
+        _queueEndUs = after + queueUs;
+    } else {
+        _queueEndUs = max(_queueEndUs, before) + (int64_t)done * 1000000LL / SAMPLE_RATE;
     }
 
-    size_t size = f.size();
-    Serial.printf("File size: %zu bytes\n", size);
-    
-    uint8_t* buf = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_DMA);
-    if (!buf) { 
-        Serial.println("DMA malloc failed");
-        f.close(); 
-        return false; 
+    _gateFramesTotal += done;
+    if (_ampOn) {
+        _gateFramesOn += done;
+        energy_add_amp(done, meanSquare);
     }
+    _silentRunFrames = silent ? _silentRunFrames + done : 0;
+    if (_ampOn && _silentRunFrames >= _gateQueueFrames + AMP_OFF_HOLD_FRAMES) {
+        amplifierOff();
+        _ampSwitches++;
+    }
+    if (_gateFramesTotal) _ampDutyPct = (uint8_t)(_gateFramesOn * 100 / _gateFramesTotal);
+}
 
-    size_t readBytes = f.read(buf, size);
-    f.close();
-    
-    Serial.printf("Read %zu bytes from file\n", readBytes);
+// Tops the DMA queue up to AMP_SETTLE_MS of silence ahead of the block that
+// woke the amp. After a timed start or a quiet stretch the queue is already
+// full of silence and nothing is added; on a plain start this delays the
+// first sample by AMP_SETTLE_MS, as the fixed delay used to.
+void AudioPlayer::padAmpSettle() {
+    static const int16_t silence[FILE_DMA_BUF_LEN] = {0};
 
-    _audioData = buf;
-    _audioSize = size;
-    _shouldFreeAudioData = true; 
-    return true;
-}
+    int64_t now = esp_timer_get_time();
+    int64_t queuedUs = _queueEndUs > now ? _queueEndUs - now : 0;
+    if (queuedUs >= AMP_SETTLE_US) return;
 
-bool AudioPlayer::playFile(const String &filename) {
-    if (_task || _isStreaming) {
-        stopCurrentPlayback();
+    size_t remaining = (size_t)((AMP_SETTLE_US - queuedUs) * SAMPLE_RATE / 1000000);
+    size_t padded = 0;
+    while (remaining > 0) {
+        size_t written = 0;
+        size_t frames = min<size_t>(remaining, FILE_DMA_BUF_LEN);
+        writeSamples((const uint8_t*)silence, frames * BYTES_PER_FRAME, &written, FLUSH_TIMEOUT_TICKS);
+        if (written == 0) break;
+        padded += written / BYTES_PER_FRAME;
+        remaining -= min(remaining, written / BYTES_PER_FRAME);
     }
-    resetPlaybackState(true);
+    _queueEndUs = max(_queueEndUs, now) + (int64_t)padded * 1000000LL / SAMPLE_RATE;
+}
 
-    stopRequested = false;
+// Ramps the output to zero over FADE_OUT_MS. `tail` holds the samples that
+// would have played next; if it runs short the last written sample is held
+// instead, which still gives a click-free ramp.
+void AudioPlayer::fadeOut(const uint8_t* tail, size_t tailLen) {
+    if (!_i2sInstalled) return;
 
-    struct Args {
-        AudioPlayer* self;
-        char* filename;
-    };
+    int16_t fade[FADE_OUT_FRAMES];
+    size_t tailFrames = tail ? tailLen / sizeof(int16_t) : 0;
+    int16_t hold = _lastSample;
 
-    Args* args = new Args{this, strdup(filename.c_str())};
-    if (!args->filename) { delete args; return false; }
+    for (size_t i = 0; i < FADE_OUT_FRAMES; i++) {
+        if (i < tailFrames) memcpy(&hold, tail + i * sizeof(int16_t), sizeof(int16_t));
+        fade[i] = (int16_t)((int32_t)hold * (int32_t)(FADE_OUT_FRAMES - i) / (int32_t)FADE_OUT_FRAMES);
+    }
 
-    if (xTaskCreate(playTask, "AudioPlay", 4096, args, 2, &_task) != pdPASS) {
-        free(args->filename);
-        delete args;
-        _task = nullptr;
-        return false;
+    size_t written = 0;
+    writeSamples((const uint8_t*)fade, sizeof(fade), &written, FLUSH_TIMEOUT_TICKS);
+}
+
+// Pushes a full DMA queue of silence, so that when this returns everything
+// audible has been played.
+void AudioPlayer::flushDma() {
+    if (!_i2sInstalled) return;
+
+    static const int16_t silence[FILE_DMA_BUF_LEN] = {0};
+    size_t remaining = _flushFrames;
+    while (remaining > 0) {
+        size_t written = 0;
+        size_t frames = min<size_t>(remaining, FILE_DMA_BUF_LEN);
+        writeSamples((const uint8_t*)silence, frames * sizeof(int16_t), &written, FLUSH_TIMEOUT_TICKS);
+        if (written == 0) break;
+        remaining -= min(remaining, written / sizeof(int16_t));
     }
+}
 
-    return true;
+// -----------------------------------------------------------------------------
+// Command interface (any task except the player task)
+// -----------------------------------------------------------------------------
+
+static TickType_t ticksLeft(TickType_t start, TickType_t timeout) {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    return elapsed < timeout ? timeout - elapsed : 0;
 }
 
-void AudioPlayer::playTask(void* arg) {
-    struct Args { AudioPlayer* self; char* filename; };
-    Args* args = static_cast<Args*>(arg);
-    AudioPlayer* self = args->self;
-    char* filename = args->filename;
-    delete args;
+// The mutex serialises the HTTP task and loop(), so one caller waits at a
+// time. Everything, including the wait for the mutex, shares one
+// SUBMIT_TIMEOUT_MS budget.
+AudioPlayer::Result AudioPlayer::submit(Command& cmd) {
+    if (!_task) return Result::Failed;
 
-    if (!self->loadFileToRam(filename)) {
-        Serial.printf("Failed to load file: %s\n", filename);
-        free(filename);
-        self->_task = nullptr;
-        vTaskDelete(nullptr);
-        return;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(SUBMIT_TIMEOUT_MS);
+    if (xSemaphoreTake(_submitLock, timeout) != pdTRUE) {
+        _busyRejects++;
+        return Result::Busy;
     }
-    Serial.printf("File loaded: %s, size=%zu bytes\n", filename, self->_audioSize);
-    free(filename);
 
-    self->startAudioOutput();
-    Serial.printf("Amplifier ON, I2S started\n");
+    portENTER_CRITICAL(&_cmdMux);
+    if (++_nextSeq == 0) _nextSeq = 1; // 0 means no command
+    cmd.seq = _nextSeq;
+    _waitSeq = cmd.seq;
+    portEXIT_CRITICAL(&_cmdMux);
 
-    constexpr size_t WAV_HEADER_SIZE = 44;
-    size_t offset = min((size_t)WAV_HEADER_SIZE, self->_audioSize);
+    Result result = Result::Busy;
+    if (xQueueSend(_queue, &cmd, ticksLeft(start, timeout)) == pdTRUE) {
+        for (;;) {
+            TickType_t left = ticksLeft(start, timeout);
 
-    i2s_zero_dma_buffer(I2S_NUM_0);
-    Serial.printf("Starting playback from offset %zu\n", offset);
-    while (offset < self->_audioSize && !self->stopRequested) {
-        size_t written = 0;
-        size_t chunk = min<size_t>(2048, self->_audioSize - offset);
+            portENTER_CRITICAL(&_cmdMux);
+            bool done = _doneSeq == cmd.seq;
+            bool ok = _doneOk;
+            // A stream write reads the caller's buffer, so once started it
+            // is waited out; each one is bounded by STREAM_WRITE_TIMEOUT_TICKS.
+            bool hold = cmd.type == CommandType::StreamWrite && _runSeq == cmd.seq;
+            // Giving up clears _waitSeq in the same critical section, so the
+            // player task cannot pick the command up after this decision.
+            bool giveUp = !done && left == 0 && !hold;
+            if (giveUp) _waitSeq = 0;
+            portEXIT_CRITICAL(&_cmdMux);
 
-        int res = i2s_write(I2S_NUM_0, self->_audioData + offset, chunk, &written, portMAX_DELAY);
-        if (res != ESP_OK) {
-            Serial.printf("i2s_write error: %d\n", res);
+            if (done) {
+                result = ok ? Result::Ok : Result::Failed;
+                break;
+            }
+            if (giveUp) break;
+            xEventGroupWaitBits(_events, EVT_CMD_DONE, pdTRUE, pdTRUE, left ? left : STREAM_HOLD_POLL_TICKS);
         }
-        offset += written;
     }
-    Serial.printf("Playback finished\n");
 
-    uint8_t* dataToFree = nullptr;
-    if (self->_shouldFreeAudioData && self->_audioData) {
-        dataToFree = self->_audioData;
-        self->_audioData = nullptr;
-        self->_shouldFreeAudioData = false;
+    // Still queued or still running: the player task drops the first and
+    // discards the result of the second.
+    portENTER_CRITICAL(&_cmdMux);
+    _waitSeq = 0;
+    portEXIT_CRITICAL(&_cmdMux);
+    xSemaphoreGive(_submitLock);
+
+    if (result == Result::Busy) {
+        _busyRejects++;
+        Serial.printf("AudioPlayer: command %u not done within %lu ms\n",
+                      (unsigned)cmd.type, (unsigned long)SUBMIT_TIMEOUT_MS);
     }
+    return result;
+}
 
-    if (dataToFree) {
-        heap_caps_free(dataToFree);
+AudioPlayer::Result AudioPlayer::playFile(const char* filename, const PlayRange &range, int64_t startAtUs) {
+    if (strlen(filename) >= MAX_PATH_LEN) {
+        Serial.printf("Path too long: %s\n", filename);
+        return Result::Failed;
     }
-    self->_audioSize = 0;
-    self->_shouldFreeAudioData = false;
-    self->resetPlaybackState(false);
-    self->_task = nullptr;
-    vTaskDelete(nullptr);
+
+    Command cmd{};
+    cmd.type = CommandType::Play;
+    strlcpy(cmd.path, filename, sizeof(cmd.path));
+    cmd.range = range;
+    cmd.startAtUs = startAtUs;
+    return submit(cmd);
 }
 
-void AudioPlayer::stop() {
-    stopRequested = true;
-    if (_task) {
-        while (_task) {
-            vTaskDelay(10 / portTICK_PERIOD_MS);
-        }
+AudioPlayer::Result AudioPlayer::playBank(const char* name, const PlayRange &range, int64_t startAtUs) {
+    if (strlen(name) >= MAX_PATH_LEN) {
+        Serial.printf("Bank name too long: %s\n", name);
+        return Result::Failed;
     }
-    _isStreaming = false;
+
+    Command cmd{};
+    cmd.type = CommandType::PlayBank;
+    strlcpy(cmd.path, name, sizeof(cmd.path));
+    cmd.range = range;
+    cmd.startAtUs = startAtUs;
+    return submit(cmd);
 }
 
-void AudioPlayer::stopStreaming() {
-    if (!_isStreaming) return;
+AudioPlayer::Result AudioPlayer::playTone(const TonePatch& patch, int64_t startAtUs) {
+    Command cmd{};
+    cmd.type = CommandType::PlayTone;
+    cmd.tone = patch;
+    cmd.startAtUs = startAtUs;
+    return submit(cmd);
+}
 
-    Serial.println("Stopping streaming...");
-    stopRequested = true;          
-    vTaskDelay(pdMS_TO_TICKS(50));                     
-    i2s_zero_dma_buffer(I2S_NUM_0);
-    resetPlaybackState(true);
+AudioPlayer::Result AudioPlayer::stop(uint32_t* latencyUs) {
+    uint32_t start = micros();
+
+    Command cmd{};
+    cmd.type = CommandType::Stop;
+    Result result = submit(cmd);
+
+    if (latencyUs) *latencyUs = micros() - start;
+    return result;
 }
 
-bool AudioPlayer::isPlaying() const { 
-    return _task != nullptr; 
+bool AudioPlayer::isPlaying() const {
+    return _events && (xEventGroupGetBits(_events) & EVT_PLAYING);
 }
 
-void AudioPlayer::setVolume(float v) { 
-    _volume = constrain(v, 0.0f, 1.0f); 
+bool AudioPlayer::isStreaming() const {
+    return _events && (xEventGroupGetBits(_events) & EVT_STREAMING);
 }
 
-static bool hasWavExtension(const String &name) {
-    return name.endsWith(".wav");
+AudioPlayer::Result AudioPlayer::playRtp(uint16_t port) {
+    Command cmd{};
+    cmd.type = CommandType::RtpStart;
+    cmd.port = port;
+    return submit(cmd);
 }
 
-bool AudioPlayer::playRandom(const char* directory) {
-    if (_task || _isStreaming) {
-        stopCurrentPlayback();
+bool AudioPlayer::isRtpActive() const {
+    return _events && (xEventGroupGetBits(_events) & EVT_RTP);
+}
+
+bool AudioPlayer::beginFlashWrite() {
+    if (!_flashLock) return true; // no player task, nothing to protect
+    xSemaphoreTake(_flashLock, portMAX_DELAY);
+    if (isPlaying() || isStreaming() || isRtpActive()) {
+        xSemaphoreGive(_flashLock);
+        return false;
     }
-    resetPlaybackState(true);
+    return true;
+}
+
+void AudioPlayer::endFlashWrite() {
+    if (_flashLock) xSemaphoreGive(_flashLock);
+}
+
+void AudioPlayer::setVolume(float v) {
+    Command cmd{};
+    cmd.type = CommandType::SetVolume;
+    cmd.volume = constrain(v, 0.0f, 1.0f);
+    submit(cmd);
+}
+
+static bool hasWavExtension(const char* name) {
+    size_t len = strlen(name);
+    return len >= 4 && strcmp(name + len - 4, ".wav") == 0;
+}
 
+// Reservoir sampling: one pass over the directory keeps a uniformly chosen
+// file without building a list.
+AudioPlayer::Result AudioPlayer::playRandom(const char* directory) {
     File dir = LittleFS.open(directory);
-    if (!dir || !dir.isDirectory()) return false;
+    if (!dir || !dir.isDirectory()) return Result::Failed;
+
+    size_t dirLen = strlen(directory);
+    const char* sep = dirLen && directory[dirLen - 1] == '/' ? "" : "/";
+    char chosen[MAX_PATH_LEN];
+    uint32_t seen = 0;
 
-    std::vector<String> wavFiles;
     File file = dir.openNextFile();
     while (file) {
-        if (!file.isDirectory() && hasWavExtension(file.name()))
-            wavFiles.push_back(String(directory) + "/" + file.name());
+        const char* name = file.name();
+        if (!file.isDirectory() && hasWavExtension(name) &&
+            dirLen + strlen(sep) + strlen(name) < sizeof(chosen)) {
+            seen++;
+            if (random(seen) == 0) {
+                snprintf(chosen, sizeof(chosen), "%s%s%s", directory, sep, name);
+            }
+        }
         file = dir.openNextFile();
     }
 
-    if (wavFiles.empty()) return false;
+    if (seen == 0) return Result::Failed;
+    return playFile(chosen);
+}
+
+AudioPlayer::Result AudioPlayer::streamUploadStart(size_t totalSize) {
+    Serial.printf("Upload stream start: %zu bytes\n", totalSize);
+
+    Command cmd{};
+    cmd.type = CommandType::StreamStart;
+    cmd.len = totalSize;
+    return submit(cmd);
+}
+
+// `buf` belongs to the HTTP task; submit() does not return while the player
+// task is writing it.
+AudioPlayer::Result AudioPlayer::streamUploadWrite(const uint8_t* buf, size_t len) {
+    Command cmd{};
+    cmd.type = CommandType::StreamWrite;
+    cmd.data = buf;
+    cmd.len = len;
+    return submit(cmd);
+}
+
+AudioPlayer::Result AudioPlayer::streamUploadEnd() {
+    Serial.println("Upload stream end");
+
+    Command cmd{};
+    cmd.type = CommandType::StreamEnd;
+    return submit(cmd);
+}
+
+AudioPlayer::Result AudioPlayer::streamUploadAbort() {
+    Serial.println("Upload stream aborted");
+
+    Command cmd{};
+    cmd.type = CommandType::StreamAbort;
+    return submit(cmd);
+}
+
+// -----------------------------------------------------------------------------
+// Player task
+// -----------------------------------------------------------------------------
 
-    int idx = random(wavFiles.size());
-    return playFile(wavFiles[idx]);
+void AudioPlayer::taskEntry(void* arg) {
+    static_cast<AudioPlayer*>(arg)->run();
 }
 
-void AudioPlayer::streamUploadStart(size_t totalSize) {
-    (void)totalSize;
+void AudioPlayer::run() {
+    Command cmd;
+    for (;;) {
+        // While the task feeds I2S itself (file or RTP) the queue is only
+        // polled between DMA buffers; otherwise it sleeps until the next
+        // command.
+        bool pumping = _state == State::Playing || _state == State::Rtp;
+        TickType_t wait = pumping ? 0 : portMAX_DELAY;
+        if (xQueueReceive(_queue, &cmd, wait) == pdTRUE) {
+            portENTER_CRITICAL(&_cmdMux);
+            bool wanted = cmd.seq == _waitSeq;
+            if (wanted) _runSeq = cmd.seq;
+            portEXIT_CRITICAL(&_cmdMux);
+            if (!wanted) continue; // its caller gave up before it started
+
+            // A start waits for a background flash write in progress and
+            // keeps the next one out until the new state is visible.
+            bool starts = cmd.type == CommandType::Play || cmd.type == CommandType::PlayBank ||
+                          cmd.type == CommandType::PlayTone || cmd.type == CommandType::StreamStart ||
+                          cmd.type == CommandType::RtpStart;
+            if (starts) xSemaphoreTake(_flashLock, portMAX_DELAY);
+            bool ok = handleCommand(cmd);
+            if (starts) xSemaphoreGive(_flashLock);
+
+            portENTER_CRITICAL(&_cmdMux);
+            _runSeq = 0;
+            _doneSeq = cmd.seq;
+            _doneOk = ok;
+            portEXIT_CRITICAL(&_cmdMux);
+            xEventGroupSetBits(_events, EVT_CMD_DONE);
+            continue;
+        }
+
+        if (_state == State::Playing) {
+            pumpPlayback();
+        } else if (_state == State::Rtp) {
+            pumpRtp();
+        }
+    }
+}
+
+bool AudioPlayer::handleCommand(const Command& cmd) {
+    switch (cmd.type) {
+        case CommandType::Play:
+            return startPlayback(cmd.path, cmd.range, cmd.startAtUs);
+
+        case CommandType::PlayBank:
+            return startBankPlayback(cmd.path, cmd.range, cmd.startAtUs);
+
+        case CommandType::PlayTone:
+            return startTonePlayback(cmd.tone, cmd.startAtUs);
+
+        case CommandType::Stop:
+            endActive(true);
+            return true;
+
+        case CommandType::StreamStart:
+            return startStream();
+
+        case CommandType::StreamWrite:
+            return writeStream(cmd.data, cmd.len);
+
+        case CommandType::StreamEnd:
+            if (_state != State::Streaming) return false;
+            endActive(false);
+            return true;
+
+        case CommandType::StreamAbort:
+            if (_state != State::Streaming) return false;
+            endActive(true);
+            return true;
+
+        case CommandType::SetVolume:
+            _volume = cmd.volume;
+            return true;
+
+        case CommandType::RtpStart:
+            return startRtp(cmd.port);
+    }
+    return false;
+}
+
+void AudioPlayer::setState(State state) {
+    _state = state;
+    xEventGroupClearBits(_events, EVT_PLAYING | EVT_STREAMING | EVT_RTP);
+    if (state == State::Playing) xEventGroupSetBits(_events, EVT_PLAYING);
+    if (state == State::Streaming) xEventGroupSetBits(_events, EVT_STREAMING);
+    if (state == State::Rtp) xEventGroupSetBits(_events, EVT_RTP);
+}
+
+// Stops whatever is active. With `fade` the output ramps down from the next
+// samples first; without it the queued audio simply plays out.
+void AudioPlayer::endActive(bool fade) {
+    if (_state == State::Idle) return;
+
+    if (_state == State::Rtp) {
+        rtp_receiver_end();
+    }
+
+    if (fade) {
+        const uint8_t* tail = nullptr;
+        size_t tailLen = 0;
+        if (_state == State::Playing && _audioData && !_armed) {
+            tail = _audioData + (_playOffset - _windowStart);
+            tailLen = _windowStart + _windowLen - _playOffset;
+        } else if (_state == State::Playing && _toneActive && !_armed) {
+            tail = (const uint8_t*)_toneBlock + _toneBlockPos;
+            tailLen = _toneBlockLen - _toneBlockPos;
+        }
+        fadeOut(tail, tailLen);
+    }
+    flushDma();
+    stopAudioOutput();
+    freeAudioData();
+    Serial.printf("Amp duty %u%% (%lu switches)\n", _ampDutyPct, (unsigned long)_ampSwitches);
+
     _uploadHeaderSkipped = false;
     _uploadHeaderBytes = 0;
-    if (_isStreaming) {       // If already streaming, signal the current stream to stop
-        stopRequested = true;
-        while (_isStreaming) vTaskDelay(5 / portTICK_PERIOD_MS);
+    _armed = false;
+    _startAtTimerUs = 0;
+    setState(State::Idle);
+    Serial.printf("Playback finished\n");
+}
+
+// Locates the PCM payload of a WAV file by walking its chunks, so files with
+// LIST or other metadata chunks still seek to the right sample. Falls back to
+// the canonical 44-byte header.
+static void findWavData(File& f, size_t* dataOffset, size_t* dataSize) {
+    size_t fileSize = f.size();
+    *dataOffset = min(WAV_HEADER_SIZE, fileSize);
+    *dataSize = fileSize - *dataOffset;
+
+    uint8_t riff[12];
+    if (f.read(riff, sizeof(riff)) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        return;
+    }
+
+    size_t pos = sizeof(riff);
+    uint8_t chunk[8];
+    while (pos + sizeof(chunk) <= fileSize) {
+        f.seek(pos);
+        if (f.read(chunk, sizeof(chunk)) != sizeof(chunk)) return;
+
+        uint32_t chunkSize;
+        memcpy(&chunkSize, chunk + 4, sizeof(chunkSize));
+        pos += sizeof(chunk);
+
+        if (memcmp(chunk, "data", 4) == 0) {
+            *dataOffset = pos;
+            *dataSize = min<size_t>(chunkSize, fileSize - pos);
+            return;
+        }
+        pos += chunkSize + (chunkSize & 1);
     }
-    startAudioOutput();
-    _isStreaming = true; 
-    stopRequested = false;
-    Serial.printf("Upload stream start: %zu bytes\n", totalSize);
 }
 
-void AudioPlayer::streamUploadWrite(const uint8_t* buf, size_t len) {
-    if (!_i2sInstalled) return;
-    if (stopRequested) {
-        Serial.println("Stop detected during stream upload");
+// Resolves `range` against a clip of `totalBytes` PCM bytes. Returns false
+// for an empty range; reports whether each end cuts into the clip.
+static bool resolveRange(const AudioPlayer::PlayRange& range, size_t totalBytes,
+                         size_t* startByte, size_t* endByte, bool* attack, bool* release) {
+    size_t totalFrames = totalBytes / BYTES_PER_FRAME;
+    size_t startFrame = range.startFrame;
+    size_t endFrame = range.endFrame ? min<size_t>(range.endFrame, totalFrames) : totalFrames;
+    if (startFrame >= endFrame) {
+        Serial.printf("Empty range %lu..%lu of %zu frames\n",
+                      (unsigned long)range.startFrame, (unsigned long)range.endFrame, totalFrames);
+        return false;
+    }
+
+    *startByte = startFrame * BYTES_PER_FRAME;
+    *endByte = endFrame * BYTES_PER_FRAME;
+    *attack = startFrame > 0;
+    *release = endFrame < totalFrames;
+    return true;
+}
+
+bool AudioPlayer::openFile(const char* filename, const PlayRange& range, bool* attack, bool* release) {
+    _file = LittleFS.open(filename, "r");
+    if (!_file) {
+        Serial.printf("Cannot open file: %s\n", filename);
+        return false;
+    }
+
+    size_t dataOffset, dataSize;
+    findWavData(_file, &dataOffset, &dataSize);
+
+    size_t startByte, endByte;
+    if (!resolveRange(range, dataSize, &startByte, &endByte, attack, release)) {
+        _file.close();
+        return false;
+    }
+
+    size_t size = endByte - startByte;
+    Serial.printf("File size: %zu bytes, streaming %zu from offset %zu\n",
+                  (size_t)_file.size(), size, dataOffset + startByte);
+
+    void* first;
+    void* second;
+    if (!mem_block_alloc_pair(&first, &second)) {
+        Serial.println("No pool blocks free for file playback");
+        _file.close();
+        return false;
+    }
+    _fileBlocks[0] = (uint8_t*)first;
+    _fileBlocks[1] = (uint8_t*)second;
+    _frontBlock = 0;
+
+    _file.seek(dataOffset + startByte);
+    _audioSize = size & ~(size_t)1;
+    _fileLeft = _audioSize;
+    _windowStart = 0;
+    _windowLen = readBlock(_fileBlocks[0]);
+    _audioData = _fileBlocks[0];
+    _backLen = readBlock(_fileBlocks[1]);
+    _refillPending = false;
+    if (_windowLen == 0) {
+        Serial.printf("Read nothing from file: %s\n", filename);
+        freeAudioData();
+        return false;
+    }
+    return true;
+}
+
+// Reads the next part of the range into `block`. A short read (flash error,
+// truncated file) ends the clip early rather than playing stale data.
+size_t AudioPlayer::readBlock(uint8_t* block) {
+    size_t want = min<size_t>(_fileLeft, MEM_BLOCK_SIZE);
+    size_t got = want ? _file.read(block, want) & ~(size_t)1 : 0;
+    _fileLeft = got == want ? _fileLeft - got : 0;
+    if (got < want) _audioSize = _windowStart + _windowLen + _backLen + got;
+    return got;
+}
+
+// Moves the window onto the back block once the front one is played out.
+bool AudioPlayer::nextWindow() {
+    if (!_file || _refillPending || _backLen == 0) return false;
+
+    _frontBlock ^= 1;
+    _windowStart += _windowLen;
+    _windowLen = _backLen;
+    _audioData = _fileBlocks[_frontBlock];
+    _backLen = 0;
+    _refillPending = _fileLeft > 0;
+    return true;
+}
+
+// Called right after a write, while the DMA queue still holds about
+// DMA_QUEUE_US of audio, which covers one block read from LittleFS.
+void AudioPlayer::refillBack() {
+    _backLen = readBlock(_fileBlocks[_frontBlock ^ 1]);
+    _refillPending = false;
+}
+
+// Bank clips point into flash and tones render into _toneBlock; only a file
+// holds the pool blocks and the open handle.
+void AudioPlayer::freeAudioData() {
+    if (_file) _file.close();
+    for (uint8_t*& block : _fileBlocks) {
+        if (block) mem_block_free(block);
+        block = nullptr;
+    }
+    _backLen = 0;
+    _fileLeft = 0;
+    _refillPending = false;
+    _audioData = nullptr;
+    _audioSize = 0;
+    _windowStart = 0;
+    _windowLen = 0;
+    _playOffset = 0;
+    _toneActive = false;
+    _toneBlockLen = 0;
+    _toneBlockPos = 0;
+}
+
+bool AudioPlayer::startPlayback(const char* filename, const PlayRange& range, int64_t startAtUs) {
+    endActive(true);
+    uint32_t startedUs = micros();
+
+    bool attack, release;
+    if (!openFile(filename, range, &attack, &release)) {
+        Serial.printf("Failed to load file: %s\n", filename);
+        return false;
+    }
+    Serial.printf("File opened: %s, size=%zu bytes\n", filename, _audioSize);
+
+    beginPlayback(startedUs, startAtUs, "littlefs", attack, release);
+    return true;
+}
+
+// Bank clips are raw PCM in mapped flash: no header to skip, nothing to copy
+// and nothing to free.
+bool AudioPlayer::startBankPlayback(const char* name, const PlayRange& range, int64_t startAtUs) {
+    endActive(true);
+    uint32_t startedUs = micros();
+
+    SoundBankClip clip;
+    if (!sound_bank_find(name, &clip)) {
+        Serial.printf("Not in sound bank: %s\n", name);
+        return false;
+    }
+
+    size_t startByte, endByte;
+    bool attack, release;
+    if (!resolveRange(range, clip.size, &startByte, &endByte, &attack, &release)) {
+        return false;
+    }
+
+    _audioData = clip.data + startByte;
+    _audioSize = endByte - startByte;
+    _windowStart = 0;
+    _windowLen = _audioSize;
+    beginPlayback(startedUs, startAtUs, "bank", attack, release);
+    return true;
+}
+
+bool AudioPlayer::startTonePlayback(const TonePatch& patch, int64_t startAtUs) {
+    endActive(true);
+    uint32_t startedUs = micros();
+
+    if (!_tone.start(patch, SAMPLE_RATE)) {
+        Serial.println("Empty tone patch");
+        return false;
+    }
+    _toneActive = true;
+    Serial.printf("Tone: %u notes, %lu frames\n", patch.count, (unsigned long)_tone.totalFrames());
+
+    beginPlayback(startedUs, startAtUs, "tone", false, false);
+    return true;
+}
+
+void AudioPlayer::beginPlayback(uint32_t startedUs, int64_t startAtUs, const char* source, bool attack, bool release) {
+    size_t rampBytes = min(CUT_RAMP_FRAMES * BYTES_PER_FRAME, _audioSize / 2 & ~(size_t)1);
+    _playOffset = 0;
+    _attackEnd = attack ? rampBytes : 0;
+    _releaseStart = release ? _audioSize - rampBytes : _audioSize;
+
+    startAudioOutput(false);
+    Serial.printf("I2S started\n");
+
+    i2s_zero_dma_buffer(I2S_NUM_0);
+    Serial.printf("Starting playback from offset %zu\n", _playOffset);
+
+    _lastSource = source;
+    _armFrames = 0;
+    _armed = startAtUs != 0;
+    if (_armed) {
+        // The wall clock can be slewed by NTP; pin the target to the
+        // monotonic timer once.
+        _startAtTimerUs = esp_timer_get_time() + (startAtUs - clock_sync_now_us());
+        _startRequestedUs = 0;
+        Serial.printf("Armed, start in %lld us\n", (long long)(_startAtTimerUs - esp_timer_get_time()));
+    } else {
+        _startRequestedUs = startedUs;
+    }
+    setState(State::Playing);
+}
+
+// Feeds silence until the clip can start on its target frame. The first
+// writes fill the DMA queue; after that each one-buffer write returns just as
+// a buffer is freed, which puts the end of the written stream DMA_QUEUE_US
+// ahead of the clock. When the target is less than a buffer beyond that end,
+// the remainder is padded to the exact frame and the clip follows.
+void AudioPlayer::pumpArmed() {
+    static const int16_t silence[FILE_DMA_BUF_LEN] = {0};
+
+    size_t written = 0;
+    writeGated((const uint8_t*)silence, sizeof(silence), &written, WRITE_TIMEOUT_TICKS);
+    _armFrames += written / BYTES_PER_FRAME;
+    if (_armFrames < _flushFrames || written != sizeof(silence)) return;
+
+    int64_t streamEnd = esp_timer_get_time() + DMA_QUEUE_US;
+    int64_t lead = _startAtTimerUs - streamEnd;
+    if (lead >= DMA_BUF_US) return;
+
+    size_t padFrames = lead > 0 ? (size_t)((lead * SAMPLE_RATE + 500000) / 1000000) : 0;
+    size_t remaining = padFrames;
+    while (remaining > 0) {
+        size_t frames = min<size_t>(remaining, FILE_DMA_BUF_LEN);
+        writeGated((const uint8_t*)silence, frames * BYTES_PER_FRAME, &written, FLUSH_TIMEOUT_TICKS);
+        if (written == 0) break;
+        remaining -= min(remaining, written / BYTES_PER_FRAME);
+    }
+
+    // Estimated from the queue model above, not timestamped at the output.
+    int64_t start = streamEnd + (int64_t)padFrames * 1000000LL / SAMPLE_RATE;
+    _estimatedStartSkewUs = (int32_t)constrain(start - _startAtTimerUs, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+    _armed = false;
+    _startAtTimerUs = 0;
+    _gateFramesTotal = 0; // the duty ratio covers the clip, not the wait
+    _gateFramesOn = 0;
+    Serial.printf("Timed start (%s), estimated skew %ld us\n", _lastSource, (long)_estimatedStartSkewUs);
+}
+
+void AudioPlayer::pumpPlayback() {
+    if (_armed) {
+        pumpArmed();
+        return;
+    }
+    if (_toneActive) {
+        pumpTone();
         return;
     }
 
+    if (_playOffset >= _audioSize ||
+        (_playOffset >= _windowStart + _windowLen && !nextWindow())) {
+        endActive(false);
+        return;
+    }
+
+    const uint8_t* src = _audioData + (_playOffset - _windowStart);
+    size_t written = 0;
+    size_t chunk = min<size_t>(FILE_DMA_BUF_LEN * BYTES_PER_FRAME, _windowStart + _windowLen - _playOffset);
+    size_t chunkEnd = _playOffset + chunk;
+
+    if (_playOffset < _attackEnd || chunkEnd > _releaseStart) {
+        // Chunk touches a cut-point ramp. The source may be read-only flash,
+        // so apply the gain in a scratch copy.
+        int16_t scratch[FILE_DMA_BUF_LEN];
+        size_t frames = chunk / BYTES_PER_FRAME;
+        memcpy(scratch, src, frames * BYTES_PER_FRAME);
+
+        for (size_t i = 0; i < frames; i++) {
+            size_t pos = _playOffset + i * BYTES_PER_FRAME;
+            int32_t num = CUT_RAMP_FRAMES;
+            if (pos < _attackEnd) {
+                num = min<int32_t>(num, pos / BYTES_PER_FRAME);
+            }
+            if (pos >= _releaseStart) {
+                num = min<int32_t>(num, (_audioSize - pos) / BYTES_PER_FRAME - 1);
+            }
+            scratch[i] = (int16_t)((int32_t)scratch[i] * num / (int32_t)CUT_RAMP_FRAMES);
+        }
+        writeGated((const uint8_t*)scratch, frames * BYTES_PER_FRAME, &written, WRITE_TIMEOUT_TICKS);
+    } else {
+        writeGated(src, chunk, &written, WRITE_TIMEOUT_TICKS);
+    }
+
+    markStarted(written);
+    _playOffset += written;
+    if (_refillPending) refillBack();
+}
+
+// Renders the next block once the previous one has been written out.
+void AudioPlayer::pumpTone() {
+    if (_toneBlockPos >= _toneBlockLen) {
+        _toneBlockLen = _tone.render(_toneBlock, FILE_DMA_BUF_LEN) * BYTES_PER_FRAME;
+        _toneBlockPos = 0;
+        if (_toneBlockLen == 0) {
+            endActive(false);
+            return;
+        }
+    }
+
+    size_t written = 0;
+    writeGated((const uint8_t*)_toneBlock + _toneBlockPos, _toneBlockLen - _toneBlockPos,
+               &written, WRITE_TIMEOUT_TICKS);
+    markStarted(written);
+    _toneBlockPos += written;
+}
+
+void AudioPlayer::markStarted(size_t written) {
+    if (_startRequestedUs && written > 0) {
+        _lastStartLatencyUs = micros() - _startRequestedUs;
+        _startRequestedUs = 0;
+        Serial.printf("Start latency (%s): %lu us\n", _lastSource, (unsigned long)_lastStartLatencyUs);
+    }
+}
+
+bool AudioPlayer::startStream() {
+    endActive(true);
+
+    _uploadHeaderSkipped = false;
+    _uploadHeaderBytes = 0;
+    startAudioOutput(true);
+    setState(State::Streaming);
+    return true;
+}
+
+bool AudioPlayer::writeStream(const uint8_t* buf, size_t len) {
+    if (_state != State::Streaming) {
+        return false;
+    }
+
     size_t offset = 0;
     if (!_uploadHeaderSkipped) {
-        size_t need = 44 - _uploadHeaderBytes;
-        if (len <= (int)need) {
+        size_t need = WAV_HEADER_SIZE - _uploadHeaderBytes;
+        if (len <= need) {
             _uploadHeaderBytes += len;
-            return;
+            return true;
         }
         offset = need;
-        _uploadHeaderBytes = 44;
+        _uploadHeaderBytes = WAV_HEADER_SIZE;
         _uploadHeaderSkipped = true;
         Serial.println("Upload: WAV header skipped");
     }
 
-    if (len > (int)offset) {
+    if (len > offset) {
         size_t written = 0;
-        esp_err_t res = i2s_write(I2S_NUM_0, buf + offset, len - offset, &written, 100 / portTICK_PERIOD_MS);
-        if (res != ESP_OK) Serial.printf("i2s_write error: %d\n", res);
+        writeGated(buf + offset, len - offset, &written, STREAM_WRITE_TIMEOUT_TICKS);
     }
+    return true;
 }
 
-void AudioPlayer::finishStream() {
-    stopAudioOutput();
-    _uploadHeaderSkipped = false;
-    _uploadHeaderBytes = 0;
-    resetPlaybackState(true);
-}
+// The jitter buffer does the smoothing, so RTP uses the shallow file DMA
+// queue; i2s_write blocking on it paces the pulls at the sample clock.
+bool AudioPlayer::startRtp(uint16_t port) {
+    endActive(true);
 
-void AudioPlayer::streamUploadEnd() {
-    if (!_isStreaming) return;
-    Serial.println("Upload stream end");
-    finishStream();
+    if (!rtp_receiver_begin(port)) {
+        return false;
+    }
+
+    startAudioOutput(false);
+    setState(State::Rtp);
+    return true;
 }
 
-void AudioPlayer::streamUploadAbort() {
-    Serial.println("Upload stream aborted");
-    finishStream();
+void AudioPlayer::pumpRtp() {
+    int16_t packet[RTP_MAX_FRAMES];
+    size_t frames = 0;
+    rtp_receiver_pull(packet, &frames);
+
+    const uint8_t* data = (const uint8_t*)packet;
+    size_t remaining = frames * BYTES_PER_FRAME;
+    while (remaining > 0) {
+        size_t written = 0;
+        writeGated(data, remaining, &written, FLUSH_TIMEOUT_TICKS);
+        if (written == 0) break;
+        data += written;
+        remaining -= written;
+    }
 }
@@ -1,5 +1,6 @@
 #include "battery.h"
 #include "config.h"
+#include "energy.h"
 #include <esp_sleep.h>
 
 void battery_init() {
@@ -42,6 +43,7 @@ bool battery_check_critical() {
                       voltage, BATTERY_WAKEUP_INTERVAL);
 
         esp_sleep_enable_timer_wakeup((uint64_t)BATTERY_WAKEUP_INTERVAL * 1000000ULL);
+        energy_before_sleep(EnergySleep::Battery);
         esp_deep_sleep_start();
         return true; // should never return
     }
@@ -0,0 +1,279 @@
+#include "clock_sync.h"
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include <sys/time.h>
+
+static constexpr uint32_t SYNC_MAGIC = 0x4E595343; // "CSYN"
+static constexpr uint8_t SYNC_REQUEST = 0;
+static constexpr uint8_t SYNC_REPLY = 1;
+static constexpr uint32_t SAMPLE_SPACING_MS = 20;
+static constexpr time_t VALID_EPOCH = 1700000000; // NTP has set the clock
+static constexpr uint32_t TASK_STACK_SIZE = 4096;
+static constexpr UBaseType_t TASK_PRIORITY = 1;    // below the player (2)
+
+// Timestamps are microseconds since the epoch. Requests carry the raw local
+// clock; replies carry the responder's corrected clock, so a node can follow
+// a peer that itself follows another.
+struct __attribute__((packed)) SyncPacket {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t seq;
+    uint16_t reserved;
+    int64_t t1;   // requester send
+    int64_t t2;   // responder receive
+    int64_t t3;   // responder send
+};
+
+static AsyncUDP udp;
+static bool started = false;
+
+// Shared with the HTTP and AsyncUDP tasks. A 64-bit offset is not written
+// atomically on this core, so it is only touched under stateMux.
+static portMUX_TYPE stateMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Measurements run on their own task, so neither the HTTP task nor loop()
+// waits out the probes. The AsyncUDP task hands each reply to it through
+// replyReady; pendingSeq, reply and replyArrivedUs are only touched under
+// stateMux.
+static TaskHandle_t task = nullptr;
+static StaticTask_t taskBuffer;
+static StackType_t taskStack[TASK_STACK_SIZE];
+static SemaphoreHandle_t replyReady = nullptr;
+static uint8_t pendingSeq = 0;
+static SyncPacket reply;
+static int64_t replyArrivedUs = 0;
+static int64_t offsetUs = 0;
+static IPAddress reference;
+static ClockSyncResult lastResult{};
+static IPAddress requestedPeer;    // waiting for the task, if set
+static uint32_t generation = 0;    // bumped by a request or a clear
+static bool measuring = false;
+static bool lastFailed = false;
+
+static bool is_set(const IPAddress& ip) {
+    return !(ip == IPAddress());
+}
+
+static int64_t current_offset() {
+    portENTER_CRITICAL(&stateMux);
+    int64_t offset = offsetUs;
+    portEXIT_CRITICAL(&stateMux);
+    return offset;
+}
+
+static int64_t raw_now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+int64_t clock_sync_now_us() {
+    return raw_now_us() + current_offset();
+}
+
+bool clock_sync_time_valid() {
+    return time(nullptr) > VALID_EPOCH;
+}
+
+bool clock_sync_start_time(uint64_t epochMs, int64_t* startAtUs) {
+    if (!clock_sync_time_valid()) return false;
+
+    int64_t at = (int64_t)epochMs * 1000LL;
+    int64_t lead = at - clock_sync_now_us();
+    if (lead <= 0 || lead > (int64_t)PLAY_AT_MAX_LEAD_MS * 1000LL) return false;
+
+    *startAtUs = at;
+    return true;
+}
+
+static void handle_packet(AsyncUDPPacket& packet) {
+    int64_t arrived = raw_now_us();
+    if (packet.length() != sizeof(SyncPacket)) return;
+
+    SyncPacket msg;
+    memcpy(&msg, packet.data(), sizeof(msg));
+    if (msg.magic != SYNC_MAGIC) return;
+
+    if (msg.type == SYNC_REQUEST) {
+        msg.type = SYNC_REPLY;
+        msg.t2 = arrived + current_offset();
+        msg.t3 = clock_sync_now_us();
+        packet.write((const uint8_t*)&msg, sizeof(msg));
+    } else if (msg.type == SYNC_REPLY) {
+        // The first reply to the outstanding probe is kept; a duplicate or
+        // late one finds pendingSeq cleared and cannot overwrite it.
+        portENTER_CRITICAL(&stateMux);
+        bool wanted = msg.seq != 0 && msg.seq == pendingSeq;
+        if (wanted) {
+            reply = msg;
+            replyArrivedUs = arrived;
+            pendingSeq = 0;
+        }
+        portEXIT_CRITICAL(&stateMux);
+        if (wanted) xSemaphoreGive(replyReady);
+    }
+}
+
+// NTP-style exchange: offset = ((t2 - t1) + (t3 - t4)) / 2 and
+// rtt = (t4 - t1) - (t3 - t2). Wi-Fi power save and retries add one-sided
+// delay, so only the sample with the shortest round trip is kept; its offset
+// is off by at most rtt / 2.
+static ClockSyncResult measure(const IPAddress& peer) {
+    ClockSyncResult best{};
+    static uint8_t seq = 0;
+
+    for (int i = 0; i < CLOCK_SYNC_SAMPLES; i++) {
+        xSemaphoreTake(replyReady, 0); // drop a late reply to the previous probe
+
+        SyncPacket msg{};
+        msg.magic = SYNC_MAGIC;
+        msg.type = SYNC_REQUEST;
+        if (++seq == 0) seq = 1; // 0 means no probe outstanding
+        msg.seq = seq;
+        msg.t1 = raw_now_us();
+        portENTER_CRITICAL(&stateMux);
+        pendingSeq = msg.seq;
+        portEXIT_CRITICAL(&stateMux);
+        udp.writeTo((const uint8_t*)&msg, sizeof(msg), peer, CLOCK_SYNC_PORT);
+
+        if (xSemaphoreTake(replyReady, pdMS_TO_TICKS(CLOCK_SYNC_TIMEOUT_MS)) == pdTRUE) {
+            portENTER_CRITICAL(&stateMux);
+            SyncPacket got = reply;
+            int64_t t4 = replyArrivedUs;
+            portEXIT_CRITICAL(&stateMux);
+
+            // The sequence number wraps; the echoed t1 ties the reply to
+            // this probe.
+            if (got.t1 == msg.t1) {
+                int64_t rtt = (t4 - got.t1) - (got.t3 - got.t2);
+                int64_t offset = ((got.t2 - got.t1) + (got.t3 - t4)) / 2;
+                if (rtt >= 0 && (!best.valid || rtt < best.rtt_us)) {
+                    best.valid = true;
+                    best.rtt_us = (uint32_t)rtt;
+                    best.offset_us = offset;
+                }
+                best.samples++;
+            }
+        }
+        portENTER_CRITICAL(&stateMux);
+        pendingSeq = 0;
+        portEXIT_CRITICAL(&stateMux);
+        vTaskDelay(pdMS_TO_TICKS(SAMPLE_SPACING_MS));
+    }
+    return best;
+}
+
+// Applies a measurement unless a request or clear came in meanwhile.
+static void apply(const IPAddress& peer, const ClockSyncResult& r, uint32_t gen) {
+    portENTER_CRITICAL(&stateMux);
+    bool current = gen == generation;
+    if (current && r.valid) {
+        reference = peer;
+        offsetUs = r.offset_us;
+        lastResult = r;
+    }
+    if (current) lastFailed = !r.valid;
+    measuring = is_set(requestedPeer);
+    portEXIT_CRITICAL(&stateMux);
+
+    if (!current) return;
+    if (r.valid) {
+        Serial.printf("Clock sync: offset %lld us to %s (rtt %lu us, %u/%d samples)\n",
+                      (long long)r.offset_us, peer.toString().c_str(),
+                      (unsigned long)r.rtt_us, r.samples, CLOCK_SYNC_SAMPLES);
+    } else {
+        Serial.printf("Clock sync: no reply from %s\n", peer.toString().c_str());
+    }
+}
+
+// Waits for a request; without one, re-measures the reference every
+// CLOCK_SYNC_INTERVAL_MS. Crystal drift is tens of ppm, so that keeps a
+// follower within the exchange's own accuracy.
+static void task_entry(void*) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CLOCK_SYNC_INTERVAL_MS));
+
+        portENTER_CRITICAL(&stateMux);
+        IPAddress peer = is_set(requestedPeer) ? requestedPeer : reference;
+        requestedPeer = IPAddress();
+        uint32_t gen = generation;
+        measuring = is_set(peer);
+        portEXIT_CRITICAL(&stateMux);
+
+        if (!is_set(peer)) continue;
+        apply(peer, measure(peer), gen);
+    }
+}
+
+void clock_sync_init() {
+    if (started) return;
+
+    replyReady = xSemaphoreCreateBinary();
+    if (!replyReady) {
+        Serial.println("Clock sync: failed to create semaphore");
+        return;
+    }
+    if (!udp.listen(CLOCK_SYNC_PORT)) {
+        Serial.printf("Clock sync: cannot listen on UDP %u\n", CLOCK_SYNC_PORT);
+        return;
+    }
+    udp.onPacket(handle_packet);
+    task = xTaskCreateStatic(task_entry, "ClockSync", TASK_STACK_SIZE, nullptr, TASK_PRIORITY, taskStack, &taskBuffer);
+    if (!task) {
+        Serial.println("Clock sync: task creation failed");
+        return;
+    }
+    started = true;
+    Serial.printf("Clock sync: answering on UDP %u\n", CLOCK_SYNC_PORT);
+}
+
+bool clock_sync_request(const IPAddress& peer) {
+    if (!started || !is_set(peer)) return false;
+
+    portENTER_CRITICAL(&stateMux);
+    requestedPeer = peer;
+    generation++;
+    measuring = true;
+    portEXIT_CRITICAL(&stateMux);
+    xTaskNotifyGive(task);
+    return true;
+}
+
+bool clock_sync_measuring() {
+    portENTER_CRITICAL(&stateMux);
+    bool busy = measuring;
+    portEXIT_CRITICAL(&stateMux);
+    return busy;
+}
+
+bool clock_sync_last_failed() {
+    portENTER_CRITICAL(&stateMux);
+    bool failed = lastFailed;
+    portEXIT_CRITICAL(&stateMux);
+    return failed;
+}
+
+void clock_sync_clear_reference() {
+    portENTER_CRITICAL(&stateMux);
+    reference = IPAddress();
+    requestedPeer = IPAddress();
+    generation++;
+    offsetUs = 0;
+    lastResult = ClockSyncResult{};
+    lastFailed = false;
+    portEXIT_CRITICAL(&stateMux);
+}
+
+ClockSyncResult clock_sync_last_result() {
+    portENTER_CRITICAL(&stateMux);
+    ClockSyncResult r = lastResult;
+    portEXIT_CRITICAL(&stateMux);
+    return r;
+}
+
+IPAddress clock_sync_reference() {
+    portENTER_CRITICAL(&stateMux);
+    IPAddress peer = reference;
+    portEXIT_CRITICAL(&stateMux);
+    return peer;
+}
@@ -0,0 +1,199 @@
+#include <ArduinoJson.h>
+
+#include "commands.h"
+#include "control.h"
+#include "json_arena.h"
+#include "json_out.h"
+#include "sprites.h"
+#include "tones.h"
+#include "clock_sync.h"
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+
+static AudioPlayer* audioPlayer = nullptr;
+
+// Batches are handled on the AsyncTCP task one at a time, so a single parse
+// arena is enough.
+alignas(JsonArena::ALIGN) static uint8_t batchArena[CONTROL_BATCH_JSON_ARENA];
+
+// -----------------------------------------------------------------------------
+// Command execution
+// -----------------------------------------------------------------------------
+
+using Result = AudioPlayer::Result;
+
+Result commands_play_file(const char* name, const AudioPlayer::PlayRange& range, int64_t startAtUs) {
+    char path[SPRITE_PATH_LEN];
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    return audioPlayer->playFile(path, range, startAtUs);
+}
+
+Result commands_play_sprite(const char* name, int64_t startAtUs) {
+    Sprite sprite;
+    if (!sprite_lookup(name, &sprite)) return Result::Failed;
+    if (sprite.bank[0]) return audioPlayer->playBank(sprite.bank, sprite.range, startAtUs);
+    return audioPlayer->playFile(sprite.file, sprite.range, startAtUs);
+}
+
+Result commands_play_tone(const char* name, int64_t startAtUs) {
+    TonePatch patch;
+    const char* error;
+    if (!tone_load(name, &patch, &error)) return Result::Failed;
+    return audioPlayer->playTone(patch, startAtUs);
+}
+
+static bool read_range(JsonObjectConst cmd, AudioPlayer::PlayRange* range) {
+    const char* unit = cmd["unit"] | "ms";
+    bool samples = strcmp(unit, "samples") == 0;
+    if (!samples && strcmp(unit, "ms") != 0) return false;
+
+    uint32_t start = cmd["start"] | 0u;
+    uint32_t end = cmd["end"] | 0u;
+    range->startFrame = samples ? start : sprite_ms_to_frames(start);
+    range->endFrame = samples ? end : sprite_ms_to_frames(end);
+    return true;
+}
+
+// Executes one batch command and appends its result object to `out`.
+static Result run_command(JsonObjectConst cmd, JsonOut& out) {
+    const char* name = cmd["cmd"] | "";
+    Result result = Result::Failed;
+    char data[CONTROL_STATUS_JSON_LEN];
+    data[0] = '\0';
+
+    if (strcmp(name, "ping") == 0) {
+        result = Result::Ok;
+    } else if (strcmp(name, "play") == 0) {
+        AudioPlayer::PlayRange range;
+        int64_t startAtUs = 0;
+        if (!cmd["at"].isNull() && !clock_sync_start_time(cmd["at"].as<uint64_t>(), &startAtUs)) {
+            result = Result::Failed;
+        } else if (cmd["sprite"].is<const char*>()) {
+            result = commands_play_sprite(cmd["sprite"], startAtUs);
+        } else if (cmd["tone"].is<const char*>()) {
+            result = commands_play_tone(cmd["tone"], startAtUs);
+        } else if (cmd["tone"].is<JsonObjectConst>()) {
+            TonePatch patch;
+            const char* error;
+            if (tone_parse(cmd["tone"], &patch, &error)) result = audioPlayer->playTone(patch, startAtUs);
+        } else if (read_range(cmd, &range)) {
+            if (cmd["bank"].is<const char*>()) result = audioPlayer->playBank(cmd["bank"], range, startAtUs);
+            else if (cmd["file"].is<const char*>()) result = commands_play_file(cmd["file"], range, startAtUs);
+        }
+    } else if (strcmp(name, "play_random") == 0) {
+        result = audioPlayer->playRandom("/");
+    } else if (strcmp(name, "stop") == 0) {
+        uint32_t latencyUs;
+        result = audioPlayer->stop(&latencyUs);
+        snprintf(data, sizeof(data), "{\"latency_ms\":%.1f}", latencyUs / 1000.0f);
+    } else if (strcmp(name, "volume") == 0) {
+        if (cmd["value"].is<float>()) {
+            audioPlayer->setVolume(cmd["value"].as<float>());
+            result = Result::Ok;
+        }
+    } else if (strcmp(name, "status") == 0) {
+        if (control_status_json(data, sizeof(data)) < sizeof(data)) result = Result::Ok;
+    } else if (strcmp(name, "battery") == 0) {
+        if (control_battery_json(data, sizeof(data)) < sizeof(data)) result = Result::Ok;
+    } else if (strcmp(name, "sleep") == 0) {
+        if (control_sleep_json(data, sizeof(data)) < sizeof(data)) result = Result::Ok;
+    }
+
+    bool ok = result == Result::Ok;
+    out.add("{\"cmd\":\"%.16s\",\"ok\":%s", name, ok ? "true" : "false");
+    if (ok && data[0]) out.add(",\"data\":%s", data);
+    if (result == Result::Busy) out.add(",\"error\":\"busy\"");
+    out.add("}");
+    return result;
+}
+
+// Counts the elements of a top-level JSON array without parsing it, so an
+// oversized batch is refused before a document is built. Malformed input is
+// left for deserializeJson() to reject.
+static size_t count_batch_commands(const char* body, size_t len) {
+    size_t commas = 0;
+    bool any = false;
+    bool inString = false;
+    bool escaped = false;
+    int depth = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = body[i];
+        int before = depth;
+        if (inString) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '[' || c == '{') {
+            depth++;
+        } else if (c == ']' || c == '}') {
+            depth--;
+        } else if (c == ',' && depth == 1) {
+            commas++;
+        }
+        if (before >= 1 && !isspace((unsigned char)c) && !(before == 1 && c == ']')) any = true;
+    }
+    return any ? commas + 1 : 0;
+}
+
+int commands_run_batch(const char* body, size_t len, char* reply, size_t replyLen) {
+    if (count_batch_commands(body, len) > CONTROL_BATCH_MAX_COMMANDS) {
+        snprintf(reply, replyLen,
+                 "At most %d commands per batch", CONTROL_BATCH_MAX_COMMANDS);
+        return 413;
+    }
+
+    // The document lives in batchArena; a batch that does not fit is
+    // refused rather than parsed on the heap.
+    JsonArena arena(batchArena, sizeof(batchArena));
+    JsonDocument doc(&arena);
+    DeserializationError err = deserializeJson(doc, body, len,
+                                               DeserializationOption::NestingLimit(CONTROL_BATCH_MAX_NESTING));
+    if (err == DeserializationError::NoMemory || arena.overflowed()) {
+        snprintf(reply, replyLen, "Batch too large to parse");
+        return 413;
+    }
+    if (err || !doc.is<JsonArrayConst>()) {
+        snprintf(reply, replyLen, "Expected a JSON array of commands");
+        return 400;
+    }
+
+    JsonArrayConst cmds = doc.as<JsonArrayConst>();
+    JsonOut out{reply, replyLen, 0, false};
+    out.add("{\"results\":[");
+    // Commands run on the AsyncTCP task. Once the player is Busy, or the
+    // batch has used up its deadline, the rest are skipped instead of each
+    // waiting out SUBMIT_TIMEOUT_MS.
+    uint32_t startMs = millis();
+    bool stopped = false;
+    bool first = true;
+    for (JsonObjectConst cmd : cmds) {
+        if (!first) out.add(",");
+        if (stopped || millis() - startMs >= CONTROL_BATCH_DEADLINE_MS) {
+            stopped = true;
+            out.add("{\"cmd\":\"%.16s\",\"ok\":false,\"error\":\"skipped\"}", cmd["cmd"] | "");
+        } else {
+            stopped = run_command(cmd, out) == Result::Busy;
+        }
+        first = false;
+    }
+    out.add("]}");
+
+    if (out.overflow) {
+        snprintf(reply, replyLen, "Batch response too large");
+        return 500;
+    }
+    return 200;
+}
+
+// -----------------------------------------------------------------------------
+// Initialization
+// -----------------------------------------------------------------------------
+
+void commands_init(AudioPlayer& player) {
+    audioPlayer = &player;
+}
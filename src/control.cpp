@@ -0,0 +1,273 @@
+#include "commands.h"
+#include "control.h"
+#include "mem_pool.h"
+#include "sleep_manager.h"
+#include "battery.h"
+#include "sprites.h"
+#include "tones.h"
+#include "clock_sync.h"
+#include "config.h"
+
+static_assert(CONTROL_BATCH_MAX_BODY <= MEM_BLOCK_SIZE, "batch bodies must fit a mem_pool block");
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+
+static AudioPlayer* audioPlayer = nullptr;
+static AsyncWebSocket ws("/ws");
+
+// Batches and WebSocket messages are handled on the AsyncTCP task one at a
+// time, so a single response buffer is enough.
+static char batchResponse[CONTROL_BATCH_MAX_RESPONSE];
+
+// -----------------------------------------------------------------------------
+// Shared JSON bodies
+// -----------------------------------------------------------------------------
+
+size_t control_battery_json(char* out, size_t len) {
+    int raw = analogRead(BTR_ADC_PIN);
+    float voltage = battery_get_voltage();
+    float percent = battery_get_percentage();
+    float adc_voltage = (raw / 4095.0f) * 2.5f; // Raw ADC voltage before voltage divider
+
+    return snprintf(out, len,
+                    "{\"raw\":%d,\"adc_voltage\":%.3f,\"voltage\":%.2f,\"percent\":%.1f}",
+                    raw, adc_voltage, voltage, percent);
+}
+
+size_t control_sleep_json(char* out, size_t len) {
+    SleepInfo info = sleep_get_info();
+
+    return snprintf(out, len,
+                    "{\"night_now\":%s,\"current\":\"%d:%d\",\"sleep_from\":\"%d:%d\","
+                    "\"sleep_to\":\"%d:%d\",\"seconds_to_event\":%d}",
+                    info.night_now ? "true" : "false",
+                    info.current_hour, info.current_minute,
+                    info.sleep_from_hour, info.sleep_from_minute,
+                    info.sleep_to_hour, info.sleep_to_minute,
+                    info.seconds_to_event);
+}
+
+size_t control_status_json(char* out, size_t len) {
+    if (!audioPlayer) return snprintf(out, len, "{}");
+
+    ClockSyncResult clock = clock_sync_last_result();
+    MemStats mem = mem_get_stats();
+    return snprintf(out, len,
+                    "{\"playing\":%s,\"streaming\":%s,\"rtp\":%s,\"source\":\"%s\",\"start_latency_us\":%lu,"
+                    "\"armed\":%s,\"estimated_start_skew_us\":%ld,\"clock_offset_us\":%lld,\"clock_rtt_us\":%lu,"
+                    "\"amp_on\":%s,\"amp_duty_pct\":%u,\"amp_switches\":%lu,\"underruns\":%lu,\"busy_rejects\":%lu,"
+                    "\"uptime_ms\":%lu,\"heap_free\":%lu,\"heap_largest_block\":%lu}",
+                    audioPlayer->isPlaying() ? "true" : "false",
+                    audioPlayer->isStreaming() ? "true" : "false",
+                    audioPlayer->isRtpActive() ? "true" : "false",
+                    audioPlayer->lastSource(),
+                    (unsigned long)audioPlayer->lastStartLatencyUs(),
+                    audioPlayer->isArmed() ? "true" : "false",
+                    (long)audioPlayer->estimatedStartSkewUs(),
+                    (long long)clock.offset_us, (unsigned long)clock.rtt_us,
+                    audioPlayer->isAmpOn() ? "true" : "false",
+                    audioPlayer->ampDutyPct(), (unsigned long)audioPlayer->ampSwitches(),
+                    (unsigned long)audioPlayer->underruns(), (unsigned long)audioPlayer->busyRejects(),
+                    (unsigned long)millis(),
+                    (unsigned long)mem.heap_free, (unsigned long)mem.heap_largest_block);
+}
+
+using Result = AudioPlayer::Result;
+
+// -----------------------------------------------------------------------------
+// POST /batch and /tone
+// -----------------------------------------------------------------------------
+
+static void handle_body(
+    AsyncWebServerRequest* request,
+    uint8_t* data,
+    size_t len,
+    size_t index,
+    size_t total
+) {
+    if (total > CONTROL_BATCH_MAX_BODY) return;
+
+    // Bodies live in mem_pool blocks. The request would free() _tempObject
+    // itself, so the block is returned and the pointer cleared on disconnect,
+    // which always precedes its destruction.
+    if (index == 0) {
+        request->_tempObject = mem_block_alloc();
+        if (!request->_tempObject) return;
+        request->onDisconnect([request]() {
+            mem_block_free(request->_tempObject);
+            request->_tempObject = nullptr;
+        });
+    }
+    if (request->_tempObject && index + len <= total) {
+        memcpy((uint8_t*)request->_tempObject + index, data, len);
+    }
+}
+
+static void handle_batch(AsyncWebServerRequest* request) {
+    size_t len = request->contentLength();
+    if (len > CONTROL_BATCH_MAX_BODY) {
+        request->send(413, "text/plain", "Batch body too large");
+        return;
+    }
+    if (!request->_tempObject) {
+        request->send(len ? 503 : 400, "text/plain", len ? "No free request buffer" : "Missing body");
+        return;
+    }
+
+    int status = commands_run_batch((const char*)request->_tempObject, len,
+                                    batchResponse, sizeof(batchResponse));
+    request->send(status, status == 200 ? "application/json" : "text/plain", batchResponse);
+}
+
+// Body: a tone patch (see tones.h). Optional `at` as for /play.
+static void handle_tone(AsyncWebServerRequest* request) {
+    size_t len = request->contentLength();
+    if (len > CONTROL_BATCH_MAX_BODY) {
+        request->send(413, "text/plain", "Tone patch too large");
+        return;
+    }
+    if (!request->_tempObject) {
+        request->send(len ? 503 : 400, "text/plain", len ? "No free request buffer" : "Missing body");
+        return;
+    }
+
+    int64_t startAtUs = 0;
+    if (request->hasParam("at") &&
+        !clock_sync_start_time(strtoull(request->getParam("at")->value().c_str(), nullptr, 10), &startAtUs)) {
+        request->send(400, "text/plain", "at must be a future epoch time in ms (clock set, within 60 s)");
+        return;
+    }
+
+    TonePatch patch;
+    const char* error;
+    if (!tone_parse_json((const char*)request->_tempObject, len, &patch, &error)) {
+        request->send(400, "text/plain", error);
+        return;
+    }
+    Result result = audioPlayer->playTone(patch, startAtUs);
+    if (result != Result::Ok) {
+        bool busy = result == Result::Busy;
+        request->send(busy ? 503 : 409, "text/plain", busy ? "Player busy" : "Failed to start tone");
+        return;
+    }
+
+    uint32_t ms = 0;
+    for (uint8_t i = 0; i < patch.count; i++) ms += patch.notes[i].ms;
+    char json[80];
+    snprintf(json, sizeof(json), "{\"playing\":true,\"notes\":%u,\"ms\":%lu,\"armed\":%s}",
+             patch.count, (unsigned long)ms, startAtUs ? "true" : "false");
+    request->send(200, "application/json", json);
+}
+
+// -----------------------------------------------------------------------------
+// WebSocket /ws
+// -----------------------------------------------------------------------------
+
+static void handle_ws_binary(AsyncWebSocketClient* client, const uint8_t* msg, size_t len) {
+    if (len < 2) return;
+
+    uint8_t op = msg[0];
+    uint8_t seq = msg[1];
+    const uint8_t* payload = msg + 2;
+    size_t payloadLen = len - 2;
+
+    char name[SPRITE_PATH_LEN];
+    size_t nameLen = min(payloadLen, sizeof(name) - 1);
+    memcpy(name, payload, nameLen);
+    name[nameLen] = '\0';
+
+    Result result = Result::Failed;
+    uint16_t value = 0;
+
+    switch (op) {
+        case CONTROL_OP_PING:
+            result = Result::Ok;
+            break;
+        case CONTROL_OP_PLAY_FILE:
+            if (nameLen > 0) result = commands_play_file(name, AudioPlayer::PlayRange());
+            break;
+        case CONTROL_OP_PLAY_BANK:
+            if (nameLen > 0) result = audioPlayer->playBank(name);
+            break;
+        case CONTROL_OP_PLAY_SPRITE:
+            if (nameLen > 0) result = commands_play_sprite(name);
+            break;
+        case CONTROL_OP_PLAY_TONE:
+            if (nameLen > 0) result = commands_play_tone(name);
+            break;
+        case CONTROL_OP_PLAY_RANDOM:
+            result = audioPlayer->playRandom("/");
+            break;
+        case CONTROL_OP_STOP: {
+            uint32_t latencyUs;
+            result = audioPlayer->stop(&latencyUs);
+            value = (uint16_t)min<uint32_t>(latencyUs / 1000, UINT16_MAX);
+            break;
+        }
+        case CONTROL_OP_VOLUME:
+            if (payloadLen >= 1) {
+                audioPlayer->setVolume(payload[0] / 255.0f);
+                result = Result::Ok;
+            }
+            break;
+    }
+
+    uint8_t status = result == Result::Ok ? CONTROL_STATUS_OK
+                   : result == Result::Busy ? CONTROL_STATUS_BUSY : CONTROL_STATUS_FAILED;
+    uint8_t reply[5] = {op, seq, status, (uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+    client->binary(reply, sizeof(reply));
+}
+
+static void handle_ws_event(
+    AsyncWebSocket* server,
+    AsyncWebSocketClient* client,
+    AwsEventType type,
+    void* arg,
+    uint8_t* data,
+    size_t len
+) {
+    if (type == WS_EVT_CONNECT) {
+        Serial.printf("WS client %u connected\n", client->id());
+        return;
+    }
+    if (type == WS_EVT_DISCONNECT) {
+        Serial.printf("WS client %u disconnected\n", client->id());
+        return;
+    }
+    if (type != WS_EVT_DATA || !audioPlayer) return;
+
+    // Control messages are tiny; fragmented frames are not supported.
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    if (!info->final || info->index != 0 || info->len != len) {
+        client->text("Fragmented messages are not supported");
+        return;
+    }
+
+    if (info->opcode == WS_BINARY) {
+        handle_ws_binary(client, data, len);
+    } else if (len <= CONTROL_BATCH_MAX_BODY) {
+        commands_run_batch((const char*)data, len, batchResponse, sizeof(batchResponse));
+        client->text(batchResponse);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Initialization
+// -----------------------------------------------------------------------------
+
+void control_init(AsyncWebServer& server, AudioPlayer& player) {
+    audioPlayer = &player;
+    commands_init(player);
+
+    server.on("/batch", HTTP_POST, handle_batch, nullptr, handle_body);
+    server.on("/tone", HTTP_POST, handle_tone, nullptr, handle_body);
+
+    ws.onEvent(handle_ws_event);
+    server.addHandler(&ws);
+}
+
+void control_handle() {
+    ws.cleanupClients();
+}
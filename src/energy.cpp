@@ -0,0 +1,453 @@
+#include "energy.h"
+#include "config.h"
+#include "battery.h"
+#include "clock_sync.h"
+#include "audio_player.h"
+#include "json_out.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <time.h>
+
+// Defaults for config.h files written before the ledger. Power figures are
+// at the battery, so regulator losses are included.
+#ifndef ENERGY_FLUSH_INTERVAL_MS
+#define ENERGY_FLUSH_INTERVAL_MS  (60 * 60 * 1000UL)
+#endif
+#ifndef ENERGY_SAMPLE_INTERVAL_MS
+#define ENERGY_SAMPLE_INTERVAL_MS (5 * 60 * 1000UL)
+#endif
+#ifndef ENERGY_AWAKE_MW
+#define ENERGY_AWAKE_MW           90.0f   // CPU at 80 MHz, modem sleep
+#endif
+#ifndef ENERGY_WIFI_DOWN_MW
+#define ENERGY_WIFI_DOWN_MW       250.0f  // extra while connecting or scanning
+#endif
+#ifndef ENERGY_I2S_MW
+#define ENERGY_I2S_MW             10.0f
+#endif
+#ifndef ENERGY_AMP_IDLE_MW
+#define ENERGY_AMP_IDLE_MW        15.0f   // amp powered, silent
+#endif
+#ifndef ENERGY_AMP_FULL_MW
+#define ENERGY_AMP_FULL_MW        2500.0f // extra at full-scale RMS output
+#endif
+#ifndef ENERGY_SLEEP_MW
+#define ENERGY_SLEEP_MW           0.5f
+#endif
+#ifndef ENERGY_BATT_CAPACITY_MWH
+#define ENERGY_BATT_CAPACITY_MWH  18500.0f
+#endif
+
+static constexpr uint32_t LEDGER_MAGIC = 0x31474C45; // "ELG1", bump on layout changes
+static constexpr const char* NVS_NAMESPACE = "energy";
+
+static constexpr uint64_t AWAKE_UW = (uint64_t)(ENERGY_AWAKE_MW * 1000);
+static constexpr uint64_t WIFI_DOWN_UW = (uint64_t)(ENERGY_WIFI_DOWN_MW * 1000);
+static constexpr uint64_t I2S_UW = (uint64_t)(ENERGY_I2S_MW * 1000);
+static constexpr uint64_t AMP_IDLE_UW = (uint64_t)(ENERGY_AMP_IDLE_MW * 1000);
+static constexpr uint64_t AMP_FULL_UW = (uint64_t)(ENERGY_AMP_FULL_MW * 1000);
+static constexpr uint64_t SLEEP_UW = (uint64_t)(ENERGY_SLEEP_MW * 1000);
+static constexpr uint64_t FULL_SCALE_SQ = 32767ULL * 32767ULL;
+static constexpr uint64_t UJ_PER_MWH = 3600ULL * 1000;
+
+// A reading this close to BATT_MAX_VOLTAGE counts as a full charge; a rise
+// of CHARGE_RISE_MV between idle samples as a partial one.
+static constexpr uint16_t FULL_MARGIN_MV = 100;
+static constexpr uint16_t CHARGE_RISE_MV = 200;
+
+struct EnergyDay {
+    uint32_t date;            // YYYYMMDD local time, 0 before the clock was set
+    uint32_t awake_ms;
+    uint32_t wifi_down_ms;
+    uint32_t i2s_ms;
+    uint32_t amp_ms;
+    uint32_t amp_mj;
+    uint32_t sleep_night_s;
+    uint32_t sleep_battery_s;
+    uint16_t sleeps;
+    uint8_t resets;
+    uint8_t charged;          // the battery was charged during this day
+    uint16_t v_first_mv;
+    uint16_t v_last_mv;
+    uint16_t v_min_mv;
+    uint16_t v_max_mv;
+};
+
+struct Ledger {
+    uint32_t magic;
+    uint32_t seq;             // NVS flushes
+    uint32_t resets_power_on;
+    uint32_t resets_software;
+    uint32_t resets_panic;    // panics and watchdogs
+    uint32_t resets_brownout;
+    uint32_t resets_other;
+    uint32_t wakes;           // deep sleep wakeups
+    uint32_t nvs_restores;    // cold boots that fell back to the NVS copy
+    uint32_t since_flush_ms;
+    uint64_t uj_since_full;
+    bool full_seen;
+    EnergySleep sleep_reason; // pending sleep, closed on wakeup
+    uint8_t cur;              // today in days[]
+    uint16_t last_mv;
+    int64_t sleep_start;
+    EnergyDay days[ENERGY_DAYS];
+    uint32_t crc;             // NVS copies only
+};
+
+// Not initialised by the bootloader, so the ledger survives soft resets and
+// panics as well as deep sleep. The magic tells it from power-on garbage.
+RTC_NOINIT_ATTR static Ledger ledger;
+
+// Updated from the player task, the Wi-Fi event task and loop().
+static portMUX_TYPE energyMux = portMUX_INITIALIZER_UNLOCKED;
+static bool initialized = false;
+static uint8_t flags = 0;
+static int64_t lastTickUs = 0;
+static uint32_t ampUjPending = 0;
+static unsigned long lastSampleMs = 0;
+
+static uint32_t ledger_crc(const Ledger& l) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&l, offsetof(Ledger, crc));
+}
+
+static uint32_t date_key(time_t t) {
+    if (!clock_sync_time_valid()) return 0;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+// Caller holds energyMux. Undated time goes to the current day.
+static EnergyDay& select_day(uint32_t key) {
+    EnergyDay& cur = ledger.days[ledger.cur];
+    if (key == 0 || key <= cur.date) return cur;
+    if (cur.date == 0) {
+        cur.date = key;
+        return cur;
+    }
+    ledger.cur = (ledger.cur + 1) % ENERGY_DAYS;
+    EnergyDay& next = ledger.days[ledger.cur];
+    memset(&next, 0, sizeof(next));
+    next.date = key;
+    return next;
+}
+
+// Caller holds energyMux.
+static void accrue(int64_t nowUs) {
+    uint32_t dt = (uint32_t)((nowUs - lastTickUs) / 1000);
+    lastTickUs += (int64_t)dt * 1000;
+
+    EnergyDay& d = ledger.days[ledger.cur];
+    uint64_t uw = AWAKE_UW;
+    d.awake_ms += dt;
+    if (!(flags & ENERGY_WIFI_UP)) {
+        d.wifi_down_ms += dt;
+        uw += WIFI_DOWN_UW;
+    }
+    if (flags & ENERGY_I2S) {
+        d.i2s_ms += dt;
+        uw += I2S_UW;
+    }
+    if (flags & ENERGY_AMP) d.amp_ms += dt; // energy comes from energy_add_amp()
+
+    ledger.uj_since_full += uw * dt / 1000;
+    ledger.since_flush_ms += dt;
+}
+
+static void reset_ledger() {
+    memset(&ledger, 0, sizeof(ledger));
+    ledger.magic = LEDGER_MAGIC;
+}
+
+static bool load_nvs() {
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+
+    bool found = false;
+    Ledger slot;
+    for (int i = 0; i < ENERGY_NVS_SLOTS; i++) {
+        char key[4];
+        snprintf(key, sizeof(key), "l%d", i);
+        if (prefs.getBytes(key, &slot, sizeof(slot)) != sizeof(slot)) continue;
+        if (slot.magic != LEDGER_MAGIC || slot.crc != ledger_crc(slot)) continue;
+        if (found && slot.seq <= ledger.seq) continue;
+        ledger = slot;
+        found = true;
+    }
+    prefs.end();
+    return found;
+}
+
+// Writes round-robin over the slots, so each key takes 1/ENERGY_NVS_SLOTS of
+// the writes on top of NVS's own page rotation.
+static void flush() {
+    Ledger copy;
+    portENTER_CRITICAL(&energyMux);
+    ledger.seq++;
+    ledger.since_flush_ms = 0;
+    copy = ledger;
+    portEXIT_CRITICAL(&energyMux);
+    copy.crc = ledger_crc(copy);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) {
+        Serial.println("Energy ledger: NVS open failed");
+        return;
+    }
+    char key[4];
+    snprintf(key, sizeof(key), "l%lu", (unsigned long)(copy.seq % ENERGY_NVS_SLOTS));
+    if (prefs.putBytes(key, &copy, sizeof(copy)) != sizeof(copy)) {
+        Serial.println("Energy ledger: NVS write failed");
+    }
+    prefs.end();
+}
+
+// Splits the sleep that just ended at local midnights. Runs from
+// energy_init() only.
+static void credit_sleep() {
+    time_t start = (time_t)ledger.sleep_start;
+    time_t end = time(nullptr);
+    bool night = ledger.sleep_reason == EnergySleep::Night;
+    ledger.sleep_reason = EnergySleep::None;
+    if (end <= start) return;
+
+    uint32_t total = end - start;
+    while (start < end) {
+        uint32_t key = date_key(start);
+        time_t chunkEnd = end;
+        if (key) {
+            struct tm tm;
+            localtime_r(&start, &tm);
+            tm.tm_mday++;
+            tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+            tm.tm_isdst = -1;
+            time_t midnight = mktime(&tm);
+            if (midnight > start && midnight < end) chunkEnd = midnight;
+        }
+        EnergyDay& d = select_day(key);
+        if (night) d.sleep_night_s += chunkEnd - start;
+        else d.sleep_battery_s += chunkEnd - start;
+        start = chunkEnd;
+    }
+    ledger.uj_since_full += (uint64_t)total * SLEEP_UW;
+    ledger.since_flush_ms += total * 1000;
+    Serial.printf("Energy ledger: slept %lu s\n", (unsigned long)total);
+}
+
+// Loaded readings sag, so samples are only taken with audio off.
+static void sample_voltage() {
+    uint16_t mv = (uint16_t)(battery_get_voltage() * 1000);
+    uint16_t fullMv = (uint16_t)(BATT_MAX_VOLTAGE * 1000) - FULL_MARGIN_MV;
+
+    portENTER_CRITICAL(&energyMux);
+    EnergyDay& d = ledger.days[ledger.cur];
+    if (!d.v_first_mv) d.v_first_mv = mv;
+    if (!d.v_min_mv || mv < d.v_min_mv) d.v_min_mv = mv;
+    if (mv > d.v_max_mv) d.v_max_mv = mv;
+    d.v_last_mv = mv;
+
+    if (mv >= fullMv) {
+        if (ledger.last_mv < fullMv) d.charged = 1;
+        ledger.full_seen = true;
+        ledger.uj_since_full = 0;
+    } else if (ledger.last_mv && mv > ledger.last_mv + CHARGE_RISE_MV) {
+        // Partially charged: the count since full no longer means anything.
+        d.charged = 1;
+        ledger.full_seen = false;
+    }
+    ledger.last_mv = mv;
+    portEXIT_CRITICAL(&energyMux);
+}
+
+void energy_init() {
+    setenv("TZ", TIMEZONE, 1); // day boundaries before NTP has run
+    tzset();
+
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool kept = ledger.magic == LEDGER_MAGIC && ledger.cur < ENERGY_DAYS;
+    if (!kept) {
+        if (load_nvs()) {
+            ledger.nvs_restores++;
+            ledger.since_flush_ms = 0;
+        } else {
+            reset_ledger();
+        }
+        ledger.sleep_reason = EnergySleep::None;
+    }
+
+    // No other task touches the ledger yet: the player and Wi-Fi start later.
+    if (reason == ESP_RST_DEEPSLEEP) {
+        ledger.wakes++;
+        if (ledger.sleep_reason != EnergySleep::None) credit_sleep();
+    } else {
+        switch (reason) {
+            case ESP_RST_POWERON:  ledger.resets_power_on++; break;
+            case ESP_RST_SW:       ledger.resets_software++; break;
+            case ESP_RST_PANIC:
+            case ESP_RST_INT_WDT:
+            case ESP_RST_TASK_WDT:
+            case ESP_RST_WDT:      ledger.resets_panic++; break;
+            case ESP_RST_BROWNOUT: ledger.resets_brownout++; break;
+            default:               ledger.resets_other++; break;
+        }
+        EnergyDay& d = select_day(date_key(time(nullptr)));
+        if (d.resets < UINT8_MAX) d.resets++;
+    }
+
+    portENTER_CRITICAL(&energyMux);
+    lastTickUs = esp_timer_get_time();
+    initialized = true;
+    portEXIT_CRITICAL(&energyMux);
+
+    sample_voltage();
+    lastSampleMs = millis();
+    Serial.printf("Energy ledger %s (reset reason %d, %lu flushes)\n",
+                  kept ? "kept in RTC" : "loaded", (int)reason, (unsigned long)ledger.seq);
+}
+
+void energy_handle() {
+    uint32_t key = date_key(time(nullptr));
+
+    portENTER_CRITICAL(&energyMux);
+    accrue(esp_timer_get_time());
+    select_day(key);
+    bool idle = !(flags & (ENERGY_I2S | ENERGY_AMP));
+    bool due = ledger.since_flush_ms >= ENERGY_FLUSH_INTERVAL_MS;
+    portEXIT_CRITICAL(&energyMux);
+
+    if (idle && millis() - lastSampleMs >= ENERGY_SAMPLE_INTERVAL_MS) {
+        lastSampleMs = millis();
+        sample_voltage();
+    }
+    // An NVS write can stall flash reads for tens of milliseconds, long
+    // enough to starve a LittleFS clip; a due flush waits for the player to
+    // go idle.
+    if (due && idle) flush();
+}
+
+void energy_set(EnergyFlag flag, bool on) {
+    portENTER_CRITICAL(&energyMux);
+    if (initialized) accrue(esp_timer_get_time());
+    if (on) flags |= flag;
+    else flags &= ~flag;
+    portEXIT_CRITICAL(&energyMux);
+}
+
+void energy_add_amp(uint32_t frames, uint64_t meanSquare) {
+    uint64_t uw = AMP_IDLE_UW + AMP_FULL_UW * min<uint64_t>(meanSquare, FULL_SCALE_SQ) / FULL_SCALE_SQ;
+    uint32_t uj = (uint32_t)(uw * frames / AudioPlayer::SAMPLE_RATE);
+
+    portENTER_CRITICAL(&energyMux);
+    if (initialized) {
+        ledger.uj_since_full += uj;
+        ampUjPending += uj;
+        ledger.days[ledger.cur].amp_mj += ampUjPending / 1000;
+        ampUjPending %= 1000;
+    }
+    portEXIT_CRITICAL(&energyMux);
+}
+
+void energy_before_sleep(EnergySleep reason) {
+    if (!initialized) return;
+
+    portENTER_CRITICAL(&energyMux);
+    accrue(esp_timer_get_time());
+    ledger.sleep_reason = reason;
+    ledger.sleep_start = time(nullptr);
+    ledger.days[ledger.cur].sleeps++;
+    bool due = ledger.since_flush_ms >= ENERGY_FLUSH_INTERVAL_MS;
+    portEXIT_CRITICAL(&energyMux);
+
+    // RTC memory outlives the sleep, but not a battery that dies during it.
+    if (due || reason == EnergySleep::Battery) flush();
+}
+
+static float day_mwh(const EnergyDay& d) {
+    float awake = (d.awake_ms * ENERGY_AWAKE_MW + d.wifi_down_ms * ENERGY_WIFI_DOWN_MW +
+                   d.i2s_ms * ENERGY_I2S_MW) / 3600000.0f;
+    float sleep = (d.sleep_night_s + d.sleep_battery_s) * ENERGY_SLEEP_MW / 3600.0f;
+    return awake + sleep + d.amp_mj / 3600.0f;
+}
+
+static float day_hours(const EnergyDay& d) {
+    return (d.awake_ms / 1000.0f + d.sleep_night_s + d.sleep_battery_s) / 3600.0f;
+}
+
+size_t energy_json(char* out, size_t len) {
+    float voltage = battery_get_voltage();
+
+    Ledger l;
+    portENTER_CRITICAL(&energyMux);
+    if (initialized) accrue(esp_timer_get_time());
+    l = ledger;
+    portEXIT_CRITICAL(&energyMux);
+
+    // Average power over every recorded hour, and the measured energy per
+    // volt of discharge over the days since the last charge.
+    float mwh = 0, hours = 0;
+    float dischargeMwh = 0;
+    uint16_t dischargeFromMv = 0, dischargeToMv = 0;
+    for (int i = 0; i < ENERGY_DAYS; i++) {
+        const EnergyDay& d = l.days[(l.cur + 1 + i) % ENERGY_DAYS]; // oldest first
+        if (!d.date && !d.awake_ms) continue;
+        mwh += day_mwh(d);
+        hours += day_hours(d);
+        if (d.charged) {
+            dischargeMwh = 0;
+            dischargeFromMv = 0;
+            continue;
+        }
+        if (!d.v_first_mv) continue;
+        if (!dischargeFromMv) dischargeFromMv = d.v_first_mv;
+        dischargeToMv = d.v_last_mv;
+        dischargeMwh += day_mwh(d);
+    }
+
+    float avgMw = hours >= 1.0f ? mwh / hours : -1;
+    float runtimeCharge = -1, runtimeVoltage = -1, mwhPerVolt = -1;
+    if (avgMw > 0 && l.full_seen) {
+        float left = ENERGY_BATT_CAPACITY_MWH - (float)l.uj_since_full / UJ_PER_MWH;
+        runtimeCharge = max(left, 0.0f) / avgMw;
+    }
+    if (avgMw > 0 && dischargeFromMv > dischargeToMv + 20) {
+        mwhPerVolt = dischargeMwh * 1000.0f / (dischargeFromMv - dischargeToMv);
+        runtimeVoltage = max(voltage - BATT_CRITICAL_VOLTAGE, 0.0f) * mwhPerVolt / avgMw;
+    }
+
+    JsonOut json{out, len, 0, false};
+    json.add("{\"uptime_ms\":%lu,\"flushes\":%lu,\"nvs_restores\":%lu,\"wakes\":%lu,"
+             "\"resets\":{\"power_on\":%lu,\"software\":%lu,\"panic\":%lu,\"brownout\":%lu,\"other\":%lu},",
+             (unsigned long)millis(), (unsigned long)l.seq, (unsigned long)l.nvs_restores,
+             (unsigned long)l.wakes, (unsigned long)l.resets_power_on, (unsigned long)l.resets_software,
+             (unsigned long)l.resets_panic, (unsigned long)l.resets_brownout, (unsigned long)l.resets_other);
+    json.add("\"battery\":{\"voltage\":%.2f,\"full_seen\":%s,\"mwh_since_full\":%.1f},",
+             voltage, l.full_seen ? "true" : "false", (float)l.uj_since_full / UJ_PER_MWH);
+    json.add("\"prediction\":{\"avg_mw\":%.1f,\"daily_mwh\":%.0f,\"mwh_per_volt\":%.0f,"
+             "\"runtime_h_charge\":%.1f,\"runtime_h_voltage\":%.1f},\"days\":[",
+             avgMw, avgMw > 0 ? avgMw * 24 : -1, mwhPerVolt, runtimeCharge, runtimeVoltage);
+
+    bool first = true;
+    for (int i = 0; i < ENERGY_DAYS; i++) {
+        const EnergyDay& d = l.days[(l.cur + ENERGY_DAYS - i) % ENERGY_DAYS]; // newest first
+        if (!d.date && !d.awake_ms) continue;
+        float ampLevel = d.amp_ms ? (d.amp_mj - d.amp_ms * ENERGY_AMP_IDLE_MW / 1000.0f) * 100.0f /
+                                    (d.amp_ms * ENERGY_AMP_FULL_MW / 1000.0f) : 0;
+        json.add("%s{\"date\":\"%04lu-%02lu-%02lu\",\"awake_s\":%lu,\"wifi_down_s\":%lu,\"i2s_s\":%lu,"
+                 "\"amp_s\":%lu,\"amp_mj\":%lu,\"amp_level_pct\":%.1f,\"sleep_night_s\":%lu,"
+                 "\"sleep_battery_s\":%lu,\"sleeps\":%u,\"resets\":%u,\"charged\":%s,"
+                 "\"v_first\":%.2f,\"v_last\":%.2f,\"v_min\":%.2f,\"v_max\":%.2f,\"mwh\":%.1f}",
+                 first ? "" : ",", (unsigned long)(d.date / 10000), (unsigned long)(d.date / 100 % 100),
+                 (unsigned long)(d.date % 100), (unsigned long)(d.awake_ms / 1000),
+                 (unsigned long)(d.wifi_down_ms / 1000), (unsigned long)(d.i2s_ms / 1000),
+                 (unsigned long)(d.amp_ms / 1000), (unsigned long)d.amp_mj, max(ampLevel, 0.0f),
+                 (unsigned long)d.sleep_night_s, (unsigned long)d.sleep_battery_s, d.sleeps, d.resets,
+                 d.charged ? "true" : "false", d.v_first_mv / 1000.0f, d.v_last_mv / 1000.0f,
+                 d.v_min_mv / 1000.0f, d.v_max_mv / 1000.0f, day_mwh(d));
+        first = false;
+    }
+    json.add("]}");
+    return json.overflow ? 0 : json.len;
+}
@@ -3,15 +3,24 @@
 #include <esp_heap_caps.h>
 
 #include "http_server.h"
-#include "sleep_manager.h"
-#include "battery.h"
+#include "sound_bank.h"
+#include "sprites.h"
+#include "tones.h"
+#include "control.h"
+#include "rtp_receiver.h"
+#include "clock_sync.h"
+#include "wifi_manager.h"
+#include "mem_pool.h"
+#include "energy.h"
+#include "transcoder.h"
+#include "json_out.h"
 #include "config.h"
 
 // -----------------------------------------------------------------------------
 // Configuration
 // -----------------------------------------------------------------------------
 
-static constexpr size_t WAV_HEADER_SIZE = 44;
+static constexpr size_t LIST_RESPONSE_LEN = 3072;
 
 // -----------------------------------------------------------------------------
 // Globals
@@ -21,6 +30,10 @@ AsyncWebServer server(HTTP_PORT);
 static AudioPlayer* audioPlayer = nullptr;
 bool isStreaming = false;
 
+// Handlers run on the AsyncTCP task one at a time, so list responses and
+// /energy share one buffer instead of growing a String.
+static char listResponse[LIST_RESPONSE_LEN];
+
 // -----------------------------------------------------------------------------
 // Simple handlers
 // -----------------------------------------------------------------------------
@@ -30,8 +43,8 @@ void handle_ping(AsyncWebServerRequest* request) {
 }
 
 void handle_not_found(AsyncWebServerRequest* request) {
-    String msg = "404 Not Found\nURI: ";
-    msg += request->url();
+    char msg[160];
+    snprintf(msg, sizeof(msg), "404 Not Found\nURI: %s", request->url().c_str());
 
     Serial.print("Not found: ");
     Serial.println(request->url());
@@ -50,59 +63,192 @@ void handle_list(AsyncWebServerRequest* request) {
         return;
     }
 
-    String response = "[";
+    JsonOut out{listResponse, sizeof(listResponse), 0, false};
+    out.add("[");
     bool first = true;
 
     File file = root.openNextFile();
     while (file) {
-        if (!first) response += ",";
-        response += "\"" + String(file.name()) + "\"";
+        out.add("%s\"%s\"", first ? "" : ",", file.name());
         first = false;
         file = root.openNextFile();
     }
 
-    response += "]";
-    request->send(200, "application/json", response);
+    out.add("]");
+    if (out.overflow) {
+        request->send(500, "text/plain", "File list too long");
+        return;
+    }
+    request->send(200, "application/json", listResponse);
 }
 
 // -----------------------------------------------------------------------------
 // Playback handlers
 // -----------------------------------------------------------------------------
 
+// Reads optional `start`/`end` offsets; `unit` selects "ms" (default) or
+// "samples".
+static bool parse_play_range(AsyncWebServerRequest* request, AudioPlayer::PlayRange* range) {
+    bool samples = false;
+    if (request->hasParam("unit")) {
+        const String& unit = request->getParam("unit")->value();
+        if (unit == "samples") samples = true;
+        else if (unit != "ms") return false;
+    }
+
+    auto read = [&](const char* name) -> uint32_t {
+        if (!request->hasParam(name)) return 0;
+        uint32_t v = request->getParam(name)->value().toInt();
+        return samples ? v : sprite_ms_to_frames(v);
+    };
+
+    range->startFrame = read("start");
+    range->endFrame = read("end");
+    return true;
+}
+
+// Reads the optional `at` start time (epoch milliseconds). Leaves
+// `startAtUs` at 0 when absent.
+static bool parse_play_at(AsyncWebServerRequest* request, int64_t* startAtUs) {
+    *startAtUs = 0;
+    if (!request->hasParam("at")) return true;
+
+    uint64_t epochMs = strtoull(request->getParam("at")->value().c_str(), nullptr, 10);
+    return clock_sync_start_time(epochMs, startAtUs);
+}
+
+// A command the player task did not take in time is answered 503, anything
+// else that failed with `status`.
+static void send_failed(AsyncWebServerRequest* request, AudioPlayer::Result result,
+                        int status, const char* message) {
+    if (result == AudioPlayer::Result::Busy) {
+        request->send(503, "text/plain", "Player busy");
+        return;
+    }
+    request->send(status, "text/plain", message);
+}
+
+// Timed plays answer before the clip starts; the skew shows up in /status.
+static void send_armed(AsyncWebServerRequest* request, int64_t startAtUs) {
+    char json[96];
+    snprintf(json, sizeof(json), "{\"armed\":true,\"at\":%lld,\"lead_ms\":%lld}",
+             (long long)(startAtUs / 1000),
+             (long long)((startAtUs - clock_sync_now_us()) / 1000));
+    request->send(200, "application/json", json);
+}
+
 void handle_play(AsyncWebServerRequest* request) {
-    if (!request->hasParam("file")) {
+    AudioPlayer::PlayRange range;
+    if (!parse_play_range(request, &range)) {
+        request->send(400, "text/plain", "unit must be ms or samples");
+        return;
+    }
+
+    int64_t startAtUs;
+    if (!parse_play_at(request, &startAtUs)) {
+        request->send(400, "text/plain", "at must be a future epoch time in ms (clock set, within 60 s)");
+        return;
+    }
+
+    char filename[SPRITE_PATH_LEN] = "";
+    char bankName[SPRITE_PATH_LEN] = "";
+    char msg[SPRITE_PATH_LEN + 16];
+
+    if (request->hasParam("tone")) {
+        const char* name = request->getParam("tone")->value().c_str();
+        TonePatch patch;
+        const char* error;
+        if (!tone_load(name, &patch, &error)) {
+            request->send(404, "text/plain", error);
+            return;
+        }
+        AudioPlayer::Result result = audioPlayer ? audioPlayer->playTone(patch, startAtUs)
+                                                 : AudioPlayer::Result::Failed;
+        if (result != AudioPlayer::Result::Ok) {
+            send_failed(request, result, 409, "Failed to start tone");
+            return;
+        }
+        if (startAtUs) {
+            send_armed(request, startAtUs);
+            return;
+        }
+        snprintf(msg, sizeof(msg), "Playing tone:%.40s", name);
+        request->send(200, "text/plain", msg);
+        return;
+    }
+
+    if (request->hasParam("sprite")) {
+        Sprite sprite;
+        if (!sprite_lookup(request->getParam("sprite")->value().c_str(), &sprite)) {
+            request->send(404, "text/plain", "Sprite not found");
+            return;
+        }
+        strlcpy(filename, sprite.file, sizeof(filename));
+        strlcpy(bankName, sprite.bank, sizeof(bankName));
+        range = sprite.range;
+    } else if (request->hasParam("bank")) {
+        strlcpy(bankName, request->getParam("bank")->value().c_str(), sizeof(bankName));
+    } else if (request->hasParam("file")) {
+        snprintf(filename, sizeof(filename), "/%s", request->getParam("file")->value().c_str());
+    } else {
         request->send(400, "text/plain", "Missing file parameter");
         return;
     }
 
-    String filename = "/" + request->getParam("file")->value();
+    if (bankName[0]) {
+        AudioPlayer::Result result = audioPlayer ? audioPlayer->playBank(bankName, range, startAtUs)
+                                                 : AudioPlayer::Result::Failed;
+        bool started = result == AudioPlayer::Result::Ok;
+
+        Serial.printf("Bank play request: %s -> %s\n", bankName, started ? "started" : "rejected");
+
+        if (!started) {
+            send_failed(request, result, 404, "Not in sound bank or failed to start");
+            return;
+        }
+        if (startAtUs) {
+            send_armed(request, startAtUs);
+            return;
+        }
+        snprintf(msg, sizeof(msg), "Playing bank:%s", bankName);
+        request->send(200, "text/plain", msg);
+        return;
+    }
 
     if (!LittleFS.exists(filename)) {
         request->send(404, "text/plain", "File not found");
         return;
     }
 
-    bool started = audioPlayer && audioPlayer->playFile(filename);
+    AudioPlayer::Result result = audioPlayer ? audioPlayer->playFile(filename, range, startAtUs)
+                                             : AudioPlayer::Result::Failed;
+    bool started = result == AudioPlayer::Result::Ok;
 
     Serial.printf(
         "Play request: %s -> %s\n",
-        filename.c_str(),
+        filename,
         started ? "started" : "rejected"
     );
 
     if (!started) {
-        request->send(409, "text/plain", "Already playing or failed to start");
+        send_failed(request, result, 409, "Already playing or failed to start");
+        return;
+    }
+    if (startAtUs) {
+        send_armed(request, startAtUs);
         return;
     }
 
-    request->send(200, "text/plain", "Playing " + filename);
+    snprintf(msg, sizeof(msg), "Playing %s", filename);
+    request->send(200, "text/plain", msg);
 }
 
 void handle_play_random(AsyncWebServerRequest* request) {
-    if (audioPlayer && audioPlayer->playRandom("/")) {
+    AudioPlayer::Result result = audioPlayer ? audioPlayer->playRandom("/") : AudioPlayer::Result::Failed;
+    if (result == AudioPlayer::Result::Ok) {
         request->send(200, "text/plain", "Random sound playing");
     } else {
-        request->send(500, "text/plain", "Failed to play random sound");
+        send_failed(request, result, 500, "Failed to play random sound");
     }
 }
 
@@ -112,10 +258,150 @@ void handle_stop(AsyncWebServerRequest* request) {
         return;
     }
 
-    audioPlayer->stop();
-    Serial.println("Stop requested");
+    uint32_t latencyUs;
+    AudioPlayer::Result result = audioPlayer->stop(&latencyUs);
+    if (result != AudioPlayer::Result::Ok) {
+        send_failed(request, result, 500, "Stop failed");
+        return;
+    }
+    Serial.printf("Stop requested, silent after %lu us\n", (unsigned long)latencyUs);
+
+    char json[64];
+    snprintf(json, sizeof(json), "{\"stopped\":true,\"latency_ms\":%.1f}", latencyUs / 1000.0f);
+    request->send(200, "application/json", json);
+}
+
+// Handler for /status endpoint, returns JSON with the player state
+void handle_status(AsyncWebServerRequest* request) {
+    char json[CONTROL_STATUS_JSON_LEN];
+    control_status_json(json, sizeof(json));
+    request->send(200, "application/json", json);
+}
 
-    request->send(200, "text/plain", "Stopped");
+// Handler for /bank endpoint, lists the clips in the flash sound bank
+void handle_bank(AsyncWebServerRequest* request) {
+    JsonOut out{listResponse, sizeof(listResponse), 0, false};
+    out.add("[");
+    for (size_t i = 0; i < sound_bank_count(); i++) {
+        SoundBankClip clip;
+        if (!sound_bank_get(i, &clip)) break;
+        out.add("%s{\"name\":\"%s\",\"bytes\":%u}", i > 0 ? "," : "", clip.name, (unsigned)clip.size);
+    }
+    out.add("]");
+
+    if (out.overflow) {
+        request->send(500, "text/plain", "Bank list too long");
+        return;
+    }
+    request->send(200, "application/json", listResponse);
+}
+
+// -----------------------------------------------------------------------------
+// RTP streaming handlers
+// -----------------------------------------------------------------------------
+
+void handle_rtp_start(AsyncWebServerRequest* request) {
+    uint16_t port = RTP_DEFAULT_PORT;
+    if (request->hasParam("port")) {
+        long value = request->getParam("port")->value().toInt();
+        if (value < 1 || value > 65535) {
+            request->send(400, "text/plain", "Invalid port");
+            return;
+        }
+        port = (uint16_t)value;
+    }
+
+    AudioPlayer::Result result = audioPlayer ? audioPlayer->playRtp(port) : AudioPlayer::Result::Failed;
+    if (result != AudioPlayer::Result::Ok) {
+        send_failed(request, result, 409, "Cannot listen on port");
+        return;
+    }
+
+    char json[160];
+    snprintf(json, sizeof(json),
+             "{\"port\":%u,\"payload_type\":%d,\"sample_rate\":%lu,"
+             "\"encoding\":\"L16LE\",\"channels\":1,\"max_frames\":%d}",
+             port, RTP_PAYLOAD_TYPE, (unsigned long)AudioPlayer::SAMPLE_RATE, RTP_MAX_FRAMES);
+    request->send(200, "application/json", json);
+}
+
+void handle_rtp_stop(AsyncWebServerRequest* request) {
+    if (audioPlayer && audioPlayer->isRtpActive()) {
+        audioPlayer->stop();
+    }
+    request->send(200, "text/plain", "RTP stopped");
+}
+
+void handle_rtp_stats(AsyncWebServerRequest* request) {
+    RtpStats s = rtp_receiver_stats();
+
+    // Playout delay: packets waiting in the jitter buffer plus the DMA queue.
+    size_t queuedFrames = s.buffered * RTP_MAX_FRAMES +
+                          AudioPlayer::FILE_DMA_BUF_COUNT * AudioPlayer::FILE_DMA_BUF_LEN;
+    float delayMs = queuedFrames * 1000.0f / AudioPlayer::SAMPLE_RATE;
+
+    char json[384];
+    snprintf(json, sizeof(json),
+             "{\"listening\":%s,\"port\":%u,\"playing\":%s,\"received\":%lu,"
+             "\"played\":%lu,\"concealed\":%lu,\"late\":%lu,\"reordered\":%lu,"
+             "\"duplicates\":%lu,\"malformed\":%lu,\"buffered\":%lu,"
+             "\"jitter_us\":%lu,\"playout_delay_ms\":%.1f}",
+             s.listening ? "true" : "false", s.port, s.playing ? "true" : "false",
+             (unsigned long)s.received, (unsigned long)s.played, (unsigned long)s.concealed,
+             (unsigned long)s.late, (unsigned long)s.reordered, (unsigned long)s.duplicates,
+             (unsigned long)s.malformed, (unsigned long)s.buffered,
+             (unsigned long)s.jitter_us, delayMs);
+    request->send(200, "application/json", json);
+}
+
+// -----------------------------------------------------------------------------
+// Clock sync handlers
+// -----------------------------------------------------------------------------
+
+static size_t clock_json(char* out, size_t len) {
+    ClockSyncResult r = clock_sync_last_result();
+    return snprintf(out, len,
+                    "{\"time_valid\":%s,\"now_ms\":%lld,\"reference\":\"%s\","
+                    "\"offset_us\":%lld,\"rtt_us\":%lu,\"samples\":%u,"
+                    "\"measuring\":%s,\"last_failed\":%s}",
+                    clock_sync_time_valid() ? "true" : "false",
+                    (long long)(clock_sync_now_us() / 1000),
+                    clock_sync_reference().toString().c_str(),
+                    (long long)r.offset_us, (unsigned long)r.rtt_us, r.samples,
+                    clock_sync_measuring() ? "true" : "false",
+                    clock_sync_last_failed() ? "true" : "false");
+}
+
+void handle_clock(AsyncWebServerRequest* request) {
+    char json[224];
+    clock_json(json, sizeof(json));
+    request->send(200, "application/json", json);
+}
+
+// /clock/sync?peer=<ip> starts measuring against that node and answers 202
+// at once; the exchange takes up to two seconds, so poll /clock until
+// "measuring" is false. Without `peer` the local NTP clock is used again.
+void handle_clock_sync(AsyncWebServerRequest* request) {
+    if (!request->hasParam("peer")) {
+        clock_sync_clear_reference();
+        handle_clock(request);
+        return;
+    }
+
+    IPAddress peer;
+    if (!peer.fromString(request->getParam("peer")->value())) {
+        request->send(400, "text/plain", "Invalid peer address");
+        return;
+    }
+
+    if (!clock_sync_request(peer)) {
+        request->send(503, "text/plain", "Clock sync not running");
+        return;
+    }
+
+    char json[224];
+    clock_json(json, sizeof(json));
+    request->send(202, "application/json", json);
 }
 
 // -----------------------------------------------------------------------------
@@ -129,22 +415,13 @@ void handle_stream_upload(
     size_t index,
     size_t total
 ) {
-    static bool headerSkipped = false;
-    static size_t headerBytes = 0;
-
     // Upload start
     if (index == 0) {
         isStreaming = true;
-        headerSkipped = false;
-        headerBytes = 0;
 
         Serial.printf("Stream upload start, total=%zu\n", total);
 
-        if (audioPlayer && audioPlayer->isPlaying()) {
-            audioPlayer->stop();
-            vTaskDelay(pdMS_TO_TICKS(100));
-        }
-
+        // Starting a stream fades out anything that is still playing.
         if (audioPlayer) {
             audioPlayer->streamUploadStart(total);
         }
@@ -154,30 +431,13 @@ void handle_stream_upload(
         return;
     }
 
-    // Skip WAV header (first 44 bytes)
-    size_t offset = 0;
-    if (!headerSkipped) {
-        size_t remaining = WAV_HEADER_SIZE - headerBytes;
-
-        if (len <= remaining) {
-            headerBytes += len;
-            return;
-        }
-
-        offset = remaining;
-        headerBytes = WAV_HEADER_SIZE;
-        headerSkipped = true;
-
-        Serial.println("WAV header skipped");
-    }
-
-    // Send raw PCM data directly to I2S
-    if (len > offset) {
-        if (audioPlayer->stopRequested) {
+    // The player skips the 44-byte WAV header itself, across chunks.
+    if (len > 0) {
+        if (!audioPlayer->isStreaming()) {
             Serial.println("Stop detected during stream upload");
             return;
         }
-        audioPlayer->streamUploadWrite(data + offset, len - offset);
+        audioPlayer->streamUploadWrite(data, len);
     }
 
     // Upload end
@@ -191,42 +451,103 @@ void handle_stream_upload(
 
 // Handler for /battery endpoint, returns JSON with voltage and percentage
 void handle_battery(AsyncWebServerRequest* request) {
-    int raw = analogRead(BTR_ADC_PIN);
-    float voltage = battery_get_voltage();
-    float percent = battery_get_percentage();
-    float adc_voltage = (raw / 4095.0f) * 2.5f; // Raw ADC voltage before voltage divider
-
-    String response = "{";
-    response += "\"raw\":" + String(raw) + ",";
-    response += "\"adc_voltage\":" + String(adc_voltage, 3) + ",";
-    response += "\"voltage\":" + String(voltage, 2) + ",";
-    response += "\"percent\":" + String(percent, 1);
-    response += "}";
-
-    request->send(200, "application/json", response);
+    char json[128];
+    control_battery_json(json, sizeof(json));
+    request->send(200, "application/json", json);
 }
 
-// Handler for /sleep endpoint, returns JSON with sleep info
-void handle_sleep(AsyncWebServerRequest* request) {
-    SleepInfo info = sleep_get_info();
-
-    String json = "{";
-    json += "\"night_now\":" + String(info.night_now ? "true":"false") + ",";
-    json += "\"current\":\"" +
-            String(info.current_hour) + ":" +
-            String(info.current_minute) + "\",";
-    json += "\"sleep_from\":\"" +
-            String(info.sleep_from_hour) + ":" +
-            String(info.sleep_from_minute) + "\",";
-    json += "\"sleep_to\":\"" +
-            String(info.sleep_to_hour) + ":" +
-            String(info.sleep_to_minute) + "\",";
-    json += "\"seconds_to_event\":" + String(info.seconds_to_event);
-    json += "}";
+// Handler for /mem endpoint, returns JSON with heap fragmentation and pool use
+void handle_mem(AsyncWebServerRequest* request) {
+    MemStats s = mem_get_stats();
+
+    char json[384];
+    snprintf(json, sizeof(json),
+             "{\"arena_ok\":%s,\"heap_free\":%lu,\"heap_min_free\":%lu,\"heap_largest_block\":%lu,"
+             "\"fragmentation_pct\":%u,\"play_rejects\":%lu,"
+             "\"blocks_in_use\":%u,\"blocks_peak\":%u,\"blocks_total\":%d,\"block_failures\":%lu}",
+             s.arena_ok ? "true" : "false", (unsigned long)s.heap_free, (unsigned long)s.heap_min_free,
+             (unsigned long)s.heap_largest_block, s.fragmentation_pct,
+             (unsigned long)s.play_rejects, s.blocks_in_use, s.blocks_peak,
+             MEM_BLOCK_COUNT, (unsigned long)s.block_failures);
+    request->send(200, "application/json", json);
+}
+
+// Handler for /energy endpoint, returns JSON with the energy ledger and runtime estimate
+void handle_energy(AsyncWebServerRequest* request) {
+    if (!energy_json(listResponse, sizeof(listResponse))) {
+        request->send(500, "text/plain", "Energy response too large");
+        return;
+    }
+    request->send(200, "application/json", listResponse);
+}
+
+// Handler for GET /jobs, returns JSON with the transcoder queue
+void handle_jobs(AsyncWebServerRequest* request) {
+    if (!transcoder_jobs_json(listResponse, sizeof(listResponse))) {
+        request->send(500, "text/plain", "Jobs response too large");
+        return;
+    }
+    request->send(200, "application/json", listResponse);
+}
+
+// Handler for POST /jobs?file=<src>[&out=<dst>], queues a conversion into the
+// native format. Without `out` the source is replaced.
+void handle_jobs_add(AsyncWebServerRequest* request) {
+    if (!request->hasParam("file")) {
+        request->send(400, "text/plain", "Missing file parameter");
+        return;
+    }
 
+    char src[TRANSCODE_PATH_LEN], dst[TRANSCODE_PATH_LEN];
+    snprintf(src, sizeof(src), "/%s", request->getParam("file")->value().c_str());
+    if (request->hasParam("out")) {
+        snprintf(dst, sizeof(dst), "/%s", request->getParam("out")->value().c_str());
+    } else {
+        strlcpy(dst, src, sizeof(dst));
+    }
+
+    if (!LittleFS.exists(src)) {
+        request->send(404, "text/plain", "File not found");
+        return;
+    }
+
+    uint16_t id = transcoder_enqueue(src, dst);
+    if (id == 0) {
+        request->send(503, "text/plain", "Job queue full");
+        return;
+    }
+
+    char json[32];
+    snprintf(json, sizeof(json), "{\"id\":%u}", id);
+    request->send(202, "application/json", json);
+}
+
+// Handler for /wifi endpoint, returns JSON with link and reconnect statistics
+void handle_wifi(AsyncWebServerRequest* request) {
+    WifiStats s = wifi_get_stats();
+
+    char json[448];
+    snprintf(json, sizeof(json),
+             "{\"state\":\"%s\",\"rssi\":%d,\"channel\":%ld,\"bssid\":\"%s\","
+             "\"disconnects\":%lu,\"reconnects\":%lu,\"attempts\":%lu,\"fast_attempts\":%lu,"
+             "\"last_reason\":%u,\"boot_connect_ms\":%lu,\"last_reconnect_ms\":%lu,"
+             "\"max_reconnect_ms\":%lu,\"down_ms\":%lu,\"next_attempt_ms\":%lu}",
+             wifi_state_name(s.state), wifi_is_connected() ? WiFi.RSSI() : 0,
+             (long)WiFi.channel(), WiFi.BSSIDstr().c_str(),
+             (unsigned long)s.disconnects, (unsigned long)s.reconnects,
+             (unsigned long)s.attempts, (unsigned long)s.fast_attempts, s.last_reason,
+             (unsigned long)s.boot_connect_ms, (unsigned long)s.last_reconnect_ms,
+             (unsigned long)s.max_reconnect_ms, (unsigned long)s.down_ms,
+             (unsigned long)s.next_attempt_ms);
     request->send(200, "application/json", json);
 }
 
+// Handler for /sleep endpoint, returns JSON with sleep info
+void handle_sleep(AsyncWebServerRequest* request) {
+    char json[160];
+    control_sleep_json(json, sizeof(json));
+    request->send(200, "application/json", json);
+}
 
 // -----------------------------------------------------------------------------
 // Server initialization
@@ -240,8 +561,20 @@ void http_server_init(AudioPlayer& player) {
     server.on("/play", HTTP_GET, handle_play);
     server.on("/play_random", HTTP_GET, handle_play_random);
     server.on("/stop", HTTP_GET, handle_stop);
+    server.on("/status", HTTP_GET, handle_status);
+    server.on("/bank", HTTP_GET, handle_bank);
     server.on("/battery", HTTP_GET, handle_battery);
     server.on("/sleep", HTTP_GET, handle_sleep);
+    server.on("/wifi", HTTP_GET, handle_wifi);
+    server.on("/mem", HTTP_GET, handle_mem);
+    server.on("/energy", HTTP_GET, handle_energy);
+    server.on("/jobs", HTTP_GET, handle_jobs);
+    server.on("/jobs", HTTP_POST, handle_jobs_add);
+    server.on("/rtp/start", HTTP_GET, handle_rtp_start);
+    server.on("/rtp/stop", HTTP_GET, handle_rtp_stop);
+    server.on("/rtp/stats", HTTP_GET, handle_rtp_stats);
+    server.on("/clock", HTTP_GET, handle_clock);
+    server.on("/clock/sync", HTTP_GET, handle_clock_sync);
 
     server.on(
         "/stream",
@@ -254,6 +587,8 @@ void http_server_init(AudioPlayer& player) {
         handle_stream_upload
     );
 
+    control_init(server, player);
+
     server.onNotFound(handle_not_found);
     server.begin();
 
@@ -265,6 +600,7 @@ void http_server_init(AudioPlayer& player) {
 // -----------------------------------------------------------------------------
 
 void http_server_handle() {
-    // AsyncWebServer does not require handleClient()
-    // This function is kept for compatibility
+    // AsyncWebServer does not require handleClient(); only idle WebSocket
+    // clients need to be reaped from time to time.
+    control_handle();
 }
@@ -10,6 +10,12 @@
 #include "audio_player.h"
 #include "sleep_manager.h"
 #include "battery.h"
+#include "sound_bank.h"
+#include "sprites.h"
+#include "clock_sync.h"
+#include "mem_pool.h"
+#include "energy.h"
+#include "transcoder.h"
 
 AudioPlayer player(I2S_BCK, I2S_WS, I2S_DOUT, AMP_SD_PIN, AMP_SD_ON_STATE);
 
@@ -25,14 +31,19 @@ void setup() {
 
     delay(500); 
     battery_init();
+    energy_init(); // before the first chance to sleep, so that sleep is accounted
     battery_check_critical(); // Check battery at startup, will sleep if critical
+    mem_pool_init(); // before Wi-Fi, while the heap is still in one piece
 
-    wifi_init();
+    wifi_init(); // returns at once, reconnects in the background
     WiFi.setSleep(true);
     WiFi.setTxPower(WIFI_POWER_8_5dBm);
     esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
     esp_wifi_set_max_tx_power(38); // ≈ 9.5 dBm
     setCpuFrequencyMhz(80);
+    if (!wifi_wait_connected(WIFI_CONNECT_TIMEOUT_MS)) {
+        Serial.println("WiFi not connected yet, continuing boot");
+    }
 
     if (!LittleFS.begin(true)) {
         Serial.println("LittleFS mount failed");
@@ -40,13 +51,17 @@ void setup() {
     }
 
     Serial.println("LittleFS mounted");
+    sound_bank_init(); // optional, /play?bank= is unavailable without it
+    Serial.printf("%u sprites loaded\n", (unsigned)sprites_init());
+    player.begin();
     http_server_init(player);
     Serial.println("HTTP server started");
+    clock_sync_init();
+    transcoder_init(player); // after the player, whose activity it yields to
 
     player.setVolume(1.0f);
     if (!LittleFS.exists("/output.wav")) {
         Serial.println("Test file not found in LittleFS. Use 'pio run -t uploadfs'");
-        return;
     }
 
     configTzTime(TIMEZONE, "pool.ntp.org", "time.nist.gov");
@@ -67,8 +82,6 @@ void setup() {
 void loop() {
     static unsigned long lastCheck = 0;
     static unsigned long lastBatteryCheck = 0;
-    static unsigned long lastWifiCheck = 0;
-    static unsigned long wifiLostSince = 0;
     unsigned long now = millis();
 
     if (now - lastCheck > NIGHT_CHECK_INTERVAL_MS) { // Check sleep condition every 30 minutes
@@ -85,27 +98,8 @@ void loop() {
         battery_check_critical(); // will sleep if battery is critical
     }
 
-    // WiFi watchdog
-    if (now - lastWifiCheck > WIFI_RECHECK_INTERVAL_MS) {
-        lastWifiCheck = now;
-
-        if (WiFi.status() != WL_CONNECTED) {
-            if (wifiLostSince == 0) {
-                wifiLostSince = now;
-                Serial.println("WiFi lost");
-            }
-
-            // If wifi is lost it'll probably come back after some time,
-            // so we wait for a while before rebooting to save some power.
-            if (now - wifiLostSince > WIFI_LOST_REBOOT_DELAY_MS) {
-                Serial.println("WiFi lost too long → reboot");
-                delay(100);
-                ESP.restart();
-            }
-        } else {
-            wifiLostSince = 0;
-        }
-    }
+    http_server_handle();
+    energy_handle();
 
     if (!player.isPlaying() && !isStreaming) {
         delay(10 * 1000); // Delay to avoid busy loop when idle. Should save power while waiting for requests.
@@ -0,0 +1,101 @@
+#include "mem_pool.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static_assert(MEM_BLOCK_COUNT <= 32, "block bitmap is 32 bits wide");
+
+static constexpr uint32_t HEAP_CAPS = MALLOC_CAP_8BIT;
+static constexpr int BODY_BLOCKS = MEM_BLOCK_COUNT - 2; // the rest is the playback pair
+
+static uint8_t* blocks = nullptr;
+
+// Blocks are handed out to the AsyncTCP task and the player task and
+// returned from request teardown or the end of a clip; the spinlock covers
+// the bitmap and every counter.
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t usedMask = 0;
+static uint32_t pairMask = 0;   // blocks held as a playback pair
+static MemStats stats;
+
+bool mem_pool_init() {
+    if (blocks) return true;
+
+    blocks = (uint8_t*)heap_caps_malloc(MEM_BLOCK_SIZE * MEM_BLOCK_COUNT, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    if (!blocks) {
+        Serial.println("Memory arena allocation failed");
+        return false;
+    }
+    stats.arena_ok = true;
+
+    Serial.printf("Memory arena: %d x %u bytes blocks\n", MEM_BLOCK_COUNT, (unsigned)MEM_BLOCK_SIZE);
+    return true;
+}
+
+// Caller holds poolMux.
+static void* take_block(bool pair) {
+    for (int i = 0; i < MEM_BLOCK_COUNT; i++) {
+        if (!(usedMask & (1u << i))) {
+            usedMask |= 1u << i;
+            if (pair) pairMask |= 1u << i;
+            stats.blocks_in_use++;
+            if (stats.blocks_in_use > stats.blocks_peak) stats.blocks_peak = stats.blocks_in_use;
+            return blocks + i * MEM_BLOCK_SIZE;
+        }
+    }
+    return nullptr;
+}
+
+void* mem_block_alloc() {
+    if (!blocks) return nullptr;
+
+    portENTER_CRITICAL(&poolMux);
+    int bodies = stats.blocks_in_use - __builtin_popcount(pairMask);
+    void* block = bodies < BODY_BLOCKS ? take_block(false) : nullptr;
+    if (!block) stats.block_failures++;
+    portEXIT_CRITICAL(&poolMux);
+    return block;
+}
+
+bool mem_block_alloc_pair(void** first, void** second) {
+    *first = *second = nullptr;
+    if (!blocks) return false;
+
+    portENTER_CRITICAL(&poolMux);
+    bool ok = MEM_BLOCK_COUNT - stats.blocks_in_use >= 2;
+    if (ok) {
+        *first = take_block(true);
+        *second = take_block(true);
+    } else {
+        stats.block_failures++;
+        stats.play_rejects++;
+    }
+    portEXIT_CRITICAL(&poolMux);
+    return ok;
+}
+
+void mem_block_free(void* block) {
+    if (!block) return;
+
+    size_t i = ((uint8_t*)block - blocks) / MEM_BLOCK_SIZE;
+    if (i >= MEM_BLOCK_COUNT) return;
+
+    portENTER_CRITICAL(&poolMux);
+    if (usedMask & (1u << i)) {
+        usedMask &= ~(1u << i);
+        pairMask &= ~(1u << i);
+        stats.blocks_in_use--;
+    }
+    portEXIT_CRITICAL(&poolMux);
+}
+
+MemStats mem_get_stats() {
+    portENTER_CRITICAL(&poolMux);
+    MemStats s = stats;
+    portEXIT_CRITICAL(&poolMux);
+
+    s.heap_free = heap_caps_get_free_size(HEAP_CAPS);
+    s.heap_min_free = heap_caps_get_minimum_free_size(HEAP_CAPS);
+    s.heap_largest_block = heap_caps_get_largest_free_block(HEAP_CAPS);
+    s.fragmentation_pct = s.heap_free ? 100 - (uint8_t)((uint64_t)s.heap_largest_block * 100 / s.heap_free) : 0;
+    return s;
+}
@@ -0,0 +1,215 @@
+#include "rtp_receiver.h"
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+static_assert((RTP_JITTER_SLOTS & (RTP_JITTER_SLOTS - 1)) == 0, "RTP_JITTER_SLOTS must be a power of two");
+
+static constexpr size_t RTP_HEADER_SIZE = 12;
+static constexpr uint32_t RTP_CLOCK_RATE = 22050;
+
+struct JitterSlot {
+    bool filled;
+    uint16_t seq;
+    uint16_t frames;
+    int16_t pcm[RTP_MAX_FRAMES];
+};
+
+// Filled by the AsyncUDP task, drained by the player task. The spinlock only
+// covers slot bookkeeping and a single packet copy.
+static portMUX_TYPE rtpMux = portMUX_INITIALIZER_UNLOCKED;
+static JitterSlot slots[RTP_JITTER_SLOTS];
+static AsyncUDP udp;
+
+static bool listening = false;
+static uint16_t listenPort = 0;
+
+static bool synced = false;       // playSeq is valid
+static bool playing = false;      // prebuffer satisfied
+static uint16_t playSeq = 0;      // next sequence number to play
+static uint16_t highestSeq = 0;   // highest sequence number received
+static uint32_t missingRun = 0;
+
+static int16_t lastPcm[RTP_MAX_FRAMES];
+static uint16_t lastFrames = 0;
+
+static bool haveTransit = false;
+static int32_t lastTransit = 0;
+static uint32_t jitterQ4 = 0;     // RFC 3550 jitter in clock units, x16
+
+static RtpStats stats;
+
+static void reset_buffer() {
+    for (JitterSlot& slot : slots) slot.filled = false;
+    synced = false;
+    playing = false;
+    missingRun = 0;
+    lastFrames = 0;
+    haveTransit = false;
+    jitterQ4 = 0;
+    stats.buffered = 0;
+}
+
+static void update_jitter(uint32_t rtpTimestamp) {
+    uint32_t arrival = (uint32_t)((uint64_t)micros() * RTP_CLOCK_RATE / 1000000ULL);
+    int32_t transit = (int32_t)(arrival - rtpTimestamp);
+    if (haveTransit) {
+        int32_t d = transit - lastTransit;
+        if (d < 0) d = -d;
+        jitterQ4 += d - ((jitterQ4 + 8) >> 4);
+    }
+    lastTransit = transit;
+    haveTransit = true;
+}
+
+static void handle_packet(AsyncUDPPacket& packet) {
+    const uint8_t* p = packet.data();
+    size_t len = packet.length();
+
+    if (len < RTP_HEADER_SIZE + sizeof(int16_t) || (p[0] >> 6) != 2 ||
+        (p[0] & 0x1F) != 0 || (p[1] & 0x7F) != RTP_PAYLOAD_TYPE) {
+        portENTER_CRITICAL(&rtpMux);
+        stats.malformed++;
+        portEXIT_CRITICAL(&rtpMux);
+        return;
+    }
+
+    uint16_t seq = (uint16_t)(p[2] << 8 | p[3]);
+    uint32_t timestamp = (uint32_t)p[4] << 24 | (uint32_t)p[5] << 16 | (uint32_t)p[6] << 8 | p[7];
+    size_t frames = min<size_t>((len - RTP_HEADER_SIZE) / sizeof(int16_t), RTP_MAX_FRAMES);
+
+    portENTER_CRITICAL(&rtpMux);
+    stats.received++;
+    update_jitter(timestamp);
+
+    if (!synced) {
+        synced = true;
+        playSeq = seq;
+        highestSeq = seq;
+    }
+
+    int16_t ahead = (int16_t)(seq - playSeq);
+    if (ahead < 0) {
+        stats.late++;
+    } else {
+        if (ahead >= RTP_JITTER_SLOTS) {
+            // Sender jumped far ahead (restart or long outage): drop what is
+            // queued and resynchronise on this packet.
+            reset_buffer();
+            synced = true;
+            playSeq = seq;
+            highestSeq = seq;
+        }
+
+        if ((int16_t)(seq - highestSeq) > 0) highestSeq = seq;
+        else if (seq != highestSeq) stats.reordered++;
+
+        JitterSlot& slot = slots[seq & (RTP_JITTER_SLOTS - 1)];
+        if (slot.filled && slot.seq == seq) {
+            stats.duplicates++;
+        } else {
+            if (!slot.filled) stats.buffered++;
+            slot.filled = true;
+            slot.seq = seq;
+            slot.frames = frames;
+            memcpy(slot.pcm, p + RTP_HEADER_SIZE, frames * sizeof(int16_t));
+        }
+    }
+    portEXIT_CRITICAL(&rtpMux);
+}
+
+bool rtp_receiver_begin(uint16_t port) {
+    rtp_receiver_end();
+
+    portENTER_CRITICAL(&rtpMux);
+    reset_buffer();
+    stats = RtpStats{};
+    portEXIT_CRITICAL(&rtpMux);
+
+    if (!udp.listen(port)) {
+        Serial.printf("RTP: cannot listen on UDP %u\n", port);
+        return false;
+    }
+    udp.onPacket(handle_packet);
+
+    listening = true;
+    listenPort = port;
+    Serial.printf("RTP: listening on UDP %u\n", port);
+    return true;
+}
+
+void rtp_receiver_end() {
+    if (!listening) return;
+    udp.close();
+    listening = false;
+    Serial.println("RTP: stopped");
+}
+
+bool rtp_receiver_listening() {
+    return listening;
+}
+
+RtpPull rtp_receiver_pull(int16_t* out, size_t* frames) {
+    portENTER_CRITICAL(&rtpMux);
+
+    if (!playing) {
+        if (stats.buffered >= RTP_PREBUFFER_PACKETS) {
+            playing = true;
+            missingRun = 0;
+        } else {
+            portEXIT_CRITICAL(&rtpMux);
+            memset(out, 0, RTP_MAX_FRAMES * sizeof(int16_t));
+            *frames = RTP_MAX_FRAMES;
+            return RtpPull::Buffering;
+        }
+    }
+
+    JitterSlot& slot = slots[playSeq & (RTP_JITTER_SLOTS - 1)];
+    RtpPull result;
+
+    if (slot.filled && slot.seq == playSeq) {
+        memcpy(out, slot.pcm, slot.frames * sizeof(int16_t));
+        *frames = slot.frames;
+        memcpy(lastPcm, slot.pcm, slot.frames * sizeof(int16_t));
+        lastFrames = slot.frames;
+        slot.filled = false;
+        stats.buffered--;
+        stats.played++;
+        missingRun = 0;
+        result = RtpPull::Packet;
+    } else {
+        // Lost or not yet here: its slot is skipped rather than waited for.
+        // Repeat the last packet with 6 dB decay per step, then fall silent.
+        missingRun++;
+        stats.concealed++;
+        *frames = lastFrames ? lastFrames : RTP_MAX_FRAMES;
+        if (lastFrames && missingRun <= RTP_CONCEAL_PACKETS) {
+            for (size_t i = 0; i < lastFrames; i++) {
+                out[i] = lastPcm[i] >> missingRun;
+            }
+        } else {
+            memset(out, 0, *frames * sizeof(int16_t));
+        }
+        result = RtpPull::Concealed;
+
+        if (missingRun >= RTP_UNDERRUN_PACKETS) {
+            // The sender paused or went away. Resynchronise on whatever
+            // arrives next and prebuffer again.
+            reset_buffer();
+        }
+    }
+
+    playSeq++;
+    portEXIT_CRITICAL(&rtpMux);
+    return result;
+}
+
+RtpStats rtp_receiver_stats() {
+    portENTER_CRITICAL(&rtpMux);
+    RtpStats s = stats;
+    s.port = listenPort;
+    s.listening = listening;
+    s.playing = playing;
+    s.jitter_us = (uint32_t)((uint64_t)(jitterQ4 >> 4) * 1000000ULL / RTP_CLOCK_RATE);
+    portEXIT_CRITICAL(&rtpMux);
+    return s;
+}
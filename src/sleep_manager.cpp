@@ -1,5 +1,6 @@
 #include "sleep_manager.h"
 #include "config.h"
+#include "energy.h"
 #include <Arduino.h>
 #include <esp_sleep.h>
 
@@ -66,5 +67,6 @@ void sleep_go_until_wakeup() {
     esp_sleep_enable_timer_wakeup(
         (uint64_t)info.seconds_to_event * 1000000ULL
     );
+    energy_before_sleep(EnergySleep::Night);
     esp_deep_sleep_start();
 }
@@ -0,0 +1,115 @@
+#include "sound_bank.h"
+#include <Arduino.h>
+#include <esp_partition.h>
+
+// Image layout (little-endian), produced by tools/build_soundbank.py:
+//   SoundBankHeader
+//   SoundBankEntry[count]
+//   PCM data, each clip 4-byte aligned
+static constexpr char SOUND_BANK_LABEL[] = "soundbank";
+static constexpr uint32_t SOUND_BANK_MAGIC = 0x4B4E4253; // "SBNK"
+static constexpr uint16_t SOUND_BANK_VERSION = 1;
+static constexpr uint32_t SOUND_BANK_SAMPLE_RATE = 22050;
+static constexpr size_t SOUND_BANK_NAME_LEN = 48;
+
+struct SoundBankHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t sample_rate;
+    uint32_t image_size;
+};
+
+struct SoundBankEntry {
+    char name[SOUND_BANK_NAME_LEN]; // NUL-terminated
+    uint32_t offset;                // from start of image
+    uint32_t size;
+};
+
+static_assert(sizeof(SoundBankHeader) == 16, "bank header layout");
+static_assert(sizeof(SoundBankEntry) == 56, "bank entry layout");
+
+static const uint8_t* bankBase = nullptr;
+static const SoundBankEntry* bankEntries = nullptr;
+static uint16_t bankCount = 0;
+static spi_flash_mmap_handle_t bankHandle;
+
+bool sound_bank_init() {
+    const esp_partition_t* part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SOUND_BANK_LABEL);
+    if (!part) {
+        Serial.println("Sound bank: no partition");
+        return false;
+    }
+
+    SoundBankHeader header;
+    if (esp_partition_read(part, 0, &header, sizeof(header)) != ESP_OK ||
+        header.magic != SOUND_BANK_MAGIC || header.version != SOUND_BANK_VERSION) {
+        Serial.println("Sound bank: partition empty or invalid. Use 'pio run -t uploadbank'");
+        return false;
+    }
+
+    if (header.sample_rate != SOUND_BANK_SAMPLE_RATE ||
+        header.image_size > part->size ||
+        sizeof(header) + (size_t)header.count * sizeof(SoundBankEntry) > header.image_size) {
+        Serial.println("Sound bank: header does not match partition");
+        return false;
+    }
+
+    // Map only the used part of the partition; the MMU has few free pages.
+    const void* ptr = nullptr;
+    esp_err_t err = esp_partition_mmap(part, 0, header.image_size,
+                                       SPI_FLASH_MMAP_DATA, &ptr, &bankHandle);
+    if (err != ESP_OK) {
+        Serial.printf("Sound bank: mmap failed: %d\n", err);
+        return false;
+    }
+
+    const uint8_t* base = static_cast<const uint8_t*>(ptr);
+    const SoundBankEntry* entries =
+        reinterpret_cast<const SoundBankEntry*>(base + sizeof(SoundBankHeader));
+
+    for (uint16_t i = 0; i < header.count; i++) {
+        if ((uint64_t)entries[i].offset + entries[i].size > header.image_size ||
+            memchr(entries[i].name, '\0', SOUND_BANK_NAME_LEN) == nullptr) {
+            Serial.printf("Sound bank: entry %u is corrupt\n", i);
+            spi_flash_munmap(bankHandle);
+            return false;
+        }
+    }
+
+    bankBase = base;
+    bankEntries = entries;
+    bankCount = header.count;
+
+    Serial.printf("Sound bank mapped: %u clips, %lu bytes\n",
+                  bankCount, (unsigned long)header.image_size);
+    return true;
+}
+
+bool sound_bank_available() {
+    return bankBase != nullptr;
+}
+
+size_t sound_bank_count() {
+    return bankCount;
+}
+
+bool sound_bank_get(size_t index, SoundBankClip* clip) {
+    if (!bankBase || index >= bankCount) return false;
+
+    const SoundBankEntry& e = bankEntries[index];
+    clip->name = e.name;
+    clip->data = bankBase + e.offset;
+    clip->size = e.size;
+    return true;
+}
+
+bool sound_bank_find(const char* name, SoundBankClip* clip) {
+    for (size_t i = 0; i < bankCount; i++) {
+        if (strcmp(bankEntries[i].name, name) == 0) {
+            return sound_bank_get(i, clip);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#include "sprites.h"
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+struct SpriteEntry {
+    char name[SPRITE_NAME_LEN];
+    Sprite sprite;
+};
+
+// Filled once by sprites_init() and only read afterwards.
+static SpriteEntry table[SPRITE_MAX];
+static size_t tableCount = 0;
+
+uint32_t sprite_ms_to_frames(uint32_t ms) {
+    return (uint32_t)((uint64_t)ms * AudioPlayer::SAMPLE_RATE / 1000);
+}
+
+static uint32_t read_offset(JsonObjectConst obj, const char* msKey, const char* samplesKey) {
+    if (obj[msKey].is<uint32_t>()) return sprite_ms_to_frames(obj[msKey].as<uint32_t>());
+    return obj[samplesKey] | 0u;
+}
+
+static bool read_entry(const char* name, JsonObjectConst entry, SpriteEntry* out) {
+    const char* file = entry["file"] | "";
+    const char* bank = entry["bank"] | "";
+    if (!*file && !*bank) {
+        Serial.printf("Sprite %s has neither file nor bank\n", name);
+        return false;
+    }
+    if (strlen(name) >= sizeof(out->name) || strlen(file) + 1 >= sizeof(out->sprite.file) ||
+        strlen(bank) >= sizeof(out->sprite.bank)) {
+        Serial.printf("Sprite %s: name or path too long\n", name);
+        return false;
+    }
+
+    strlcpy(out->name, name, sizeof(out->name));
+    snprintf(out->sprite.file, sizeof(out->sprite.file), "%s%s",
+             (*file && *file != '/') ? "/" : "", file);
+    strlcpy(out->sprite.bank, bank, sizeof(out->sprite.bank));
+    out->sprite.range.startFrame = read_offset(entry, "start_ms", "start");
+    out->sprite.range.endFrame = read_offset(entry, "end_ms", "end");
+    return true;
+}
+
+size_t sprites_init() {
+    tableCount = 0;
+    File f = LittleFS.open(SPRITE_MANIFEST_PATH, "r");
+    if (!f) {
+        Serial.println("Sprite manifest not found");
+        return 0;
+    }
+
+    // Parsed on the heap, but only here at boot; the document is freed
+    // before the server starts.
+    JsonDocument doc;
+    DeserializationError err = deserializeJson(doc, f);
+    f.close();
+    if (err) {
+        Serial.printf("Sprite manifest error: %s\n", err.c_str());
+        return 0;
+    }
+
+    for (JsonPairConst kv : doc.as<JsonObjectConst>()) {
+        if (tableCount == SPRITE_MAX) {
+            Serial.printf("Sprite manifest: only the first %d sprites are used\n", SPRITE_MAX);
+            break;
+        }
+        if (read_entry(kv.key().c_str(), kv.value(), &table[tableCount])) tableCount++;
+    }
+    return tableCount;
+}
+
+bool sprite_lookup(const char* name, Sprite* sprite) {
+    for (size_t i = 0; i < tableCount; i++) {
+        if (strcmp(table[i].name, name) == 0) {
+            *sprite = table[i].sprite;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,181 @@
+#include "tone_synth.h"
+#include <math.h>
+#include <string.h>
+
+static constexpr int TABLE_BITS = 8;
+static constexpr int TABLE_SIZE = 1 << TABLE_BITS;
+static constexpr int16_t TABLE_PEAK = 32000;
+static constexpr int32_t ENV_FULL = 1 << 30;
+
+// One guard entry so interpolation never wraps the index.
+static int16_t tables[4][TABLE_SIZE + 1];
+static bool tablesReady = false;
+
+// Sums harmonics 1..maxHarmonic; `amplitude` gives each one's weight (0 to
+// skip it). Normalized to TABLE_PEAK.
+static void build_table(int16_t* table, int maxHarmonic, float (*amplitude)(int)) {
+    float acc[TABLE_SIZE];
+    float peak = 0;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        float x = 2.0f * (float)M_PI * i / TABLE_SIZE;
+        float v = 0;
+        for (int h = 1; h <= maxHarmonic; h++) {
+            float a = amplitude(h);
+            if (a != 0) v += a * sinf(h * x);
+        }
+        acc[i] = v;
+        peak = fmaxf(peak, fabsf(v));
+    }
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        table[i] = (int16_t)lrintf(acc[i] / peak * TABLE_PEAK);
+    }
+    table[TABLE_SIZE] = table[0];
+}
+
+void tone_synth_init() {
+    if (tablesReady) return;
+
+    build_table(tables[(int)ToneWave::Sine], 1, [](int) { return 1.0f; });
+    build_table(tables[(int)ToneWave::Triangle], 15, [](int h) {
+        if (!(h & 1)) return 0.0f;
+        return ((h / 2) & 1 ? -1.0f : 1.0f) / (float)(h * h);
+    });
+    build_table(tables[(int)ToneWave::Square], 15, [](int h) {
+        return h & 1 ? 1.0f / h : 0.0f;
+    });
+    build_table(tables[(int)ToneWave::Saw], 16, [](int h) { return 1.0f / h; });
+    tablesReady = true;
+}
+
+uint32_t ToneSynth::msToFrames(uint32_t ms) const {
+    return (uint32_t)((uint64_t)ms * _rate / 1000);
+}
+
+bool ToneSynth::start(const TonePatch& patch, uint32_t sampleRate) {
+    tone_synth_init();
+
+    _patch = patch;
+    if (_patch.count > TONE_MAX_NOTES) _patch.count = TONE_MAX_NOTES;
+    _rate = sampleRate;
+    _table = tables[(int)_patch.wave & 3];
+
+    _totalFrames = 0;
+    for (uint8_t i = 0; i < _patch.count; i++) _totalFrames += msToFrames(_patch.notes[i].ms);
+
+    _note = 0;
+    beginNote();
+    return !done();
+}
+
+// Skips zero-length notes; leaves _note == count at the end.
+void ToneSynth::beginNote() {
+    while (_note < _patch.count && msToFrames(_patch.notes[_note].ms) == 0) _note++;
+    if (done()) return;
+
+    const ToneNote& note = _patch.notes[_note];
+    _noteFrame = 0;
+    _noteFrames = msToFrames(note.ms);
+    uint32_t release = msToFrames(_patch.release_ms);
+    if (release > _noteFrames / 2) release = _noteFrames / 2;
+    _gateFrames = _noteFrames - release;
+
+    // Phase restarts at zero, a zero crossing for every table.
+    _phase = 0;
+    float nyquist = _rate / 2.0f;
+    _step = note.hz > 0 && note.hz < nyquist ? (uint32_t)(note.hz / _rate * 4294967296.0) : 0;
+    _amp = _step ? (int32_t)note.level * _patch.gain / 255 : 0;
+
+    _env = 0;
+    enterStage(Stage::Attack);
+}
+
+void ToneSynth::enterStage(Stage stage) {
+    _stage = stage;
+    uint32_t toGate = _gateFrames - (_noteFrame < _gateFrames ? _noteFrame : _gateFrames);
+    uint32_t len = 0;
+
+    switch (stage) {
+        case Stage::Attack:
+            _envTarget = ENV_FULL;
+            len = msToFrames(_patch.attack_ms);
+            break;
+        case Stage::Decay:
+            _envTarget = (int32_t)((int64_t)ENV_FULL * _patch.sustain / 255);
+            len = msToFrames(_patch.decay_ms);
+            break;
+        case Stage::Sustain:
+            _envTarget = _env;
+            len = toGate;
+            break;
+        case Stage::Release:
+            _envTarget = 0;
+            len = _noteFrames - _noteFrame;
+            break;
+    }
+
+    if (stage != Stage::Release && len > toGate) len = toGate;
+    if (len == 0 && stage != Stage::Release && stage != Stage::Sustain) {
+        // Instant attack or decay.
+        if (toGate > 0) _env = _envTarget;
+    }
+    _stageLeft = len;
+    _envStep = len ? (int32_t)(((int64_t)_envTarget - _env) / (int64_t)len) : 0;
+}
+
+void ToneSynth::nextStage() {
+    if (_noteFrame >= _noteFrames) {
+        _note++;
+        beginNote();
+        return;
+    }
+    if (_noteFrame >= _gateFrames) {
+        if (_stage != Stage::Release) enterStage(Stage::Release);
+        return;
+    }
+    enterStage(_stage == Stage::Attack ? Stage::Decay : Stage::Sustain);
+}
+
+size_t ToneSynth::render(int16_t* out, size_t frames) {
+    size_t produced = 0;
+
+    while (produced < frames && !done()) {
+        if (_stageLeft == 0) {
+            nextStage();
+            continue;
+        }
+
+        uint32_t n = frames - produced;
+        if (n > _stageLeft) n = _stageLeft;
+        int16_t* dst = out + produced;
+
+        if (_amp == 0) {
+            memset(dst, 0, n * sizeof(int16_t));
+            _env += _envStep * (int32_t)n;
+        } else {
+            const int16_t* table = _table;
+            uint32_t phase = _phase;
+            uint32_t step = _step;
+            int32_t env = _env;
+            int32_t envStep = _envStep;
+            int32_t amp = _amp;
+
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t idx = phase >> (32 - TABLE_BITS);
+                int32_t frac = (phase >> (17 - TABLE_BITS)) & 0x7FFF;
+                int32_t a = table[idx];
+                int32_t s = a + (((table[idx + 1] - a) * frac) >> 15);
+                int32_t gain = ((env >> 15) * amp) >> 8; // 0..32640
+                dst[i] = (int16_t)((s * gain) >> 15);
+                phase += step;
+                env += envStep;
+            }
+            _phase = phase;
+            _env = env;
+        }
+
+        _noteFrame += n;
+        _stageLeft -= n;
+        produced += n;
+    }
+    return produced;
+}
@@ -0,0 +1,140 @@
+#include "tones.h"
+#include "json_arena.h"
+#include <LittleFS.h>
+#include <math.h>
+
+// Patches are parsed on the AsyncTCP task only (/tone, /play?tone= and
+// batches), one at a time, so one file buffer and one arena are enough.
+static char toneFile[TONE_FILE_MAX_BYTES];
+alignas(JsonArena::ALIGN) static uint8_t toneArena[TONE_JSON_ARENA];
+
+static uint8_t unit_to_u8(float v) {
+    return (uint8_t)lrintf(constrain(v, 0.0f, 1.0f) * 255);
+}
+
+// "A4", "C#5", "Bb3". Returns 0 for anything else.
+static float note_name_hz(const char* name) {
+    static const int8_t semitones[] = {9, 11, 0, 2, 4, 5, 7}; // A..G from C
+    char letter = toupper(name[0]);
+    if (letter < 'A' || letter > 'G') return 0;
+
+    int semitone = semitones[letter - 'A'];
+    const char* p = name + 1;
+    if (*p == '#') { semitone++; p++; }
+    else if (*p == 'b') { semitone--; p++; }
+
+    char* end;
+    long octave = strtol(p, &end, 10);
+    if (end == p || *end || octave < 0 || octave > 9) return 0;
+
+    int midi = (int)(octave + 1) * 12 + semitone;
+    return 440.0f * powf(2.0f, (midi - 69) / 12.0f);
+}
+
+static bool parse_pitch(JsonVariantConst v, float* hz) {
+    if (v.is<float>()) {
+        *hz = v.as<float>();
+        return *hz >= 0;
+    }
+    const char* name = v | "";
+    if (strcmp(name, "r") == 0) {
+        *hz = 0;
+        return true;
+    }
+    *hz = note_name_hz(name);
+    return *hz > 0;
+}
+
+bool tone_parse(JsonVariantConst doc, TonePatch* patch, const char** error) {
+    *patch = TonePatch();
+    if (!doc.is<JsonObjectConst>()) {
+        *error = "Expected a JSON object";
+        return false;
+    }
+
+    const char* wave = doc["wave"] | "sine";
+    if (strcmp(wave, "sine") == 0) patch->wave = ToneWave::Sine;
+    else if (strcmp(wave, "triangle") == 0) patch->wave = ToneWave::Triangle;
+    else if (strcmp(wave, "square") == 0) patch->wave = ToneWave::Square;
+    else if (strcmp(wave, "saw") == 0) patch->wave = ToneWave::Saw;
+    else {
+        *error = "wave must be sine, triangle, square or saw";
+        return false;
+    }
+
+    if (doc["gain"].is<float>()) patch->gain = unit_to_u8(doc["gain"]);
+
+    JsonArrayConst adsr = doc["adsr"];
+    if (!adsr.isNull()) {
+        if (adsr.size() != 4) {
+            *error = "adsr must be [attack_ms, decay_ms, sustain, release_ms]";
+            return false;
+        }
+        patch->attack_ms = min<uint32_t>(adsr[0] | 0u, UINT16_MAX);
+        patch->decay_ms = min<uint32_t>(adsr[1] | 0u, UINT16_MAX);
+        patch->sustain = unit_to_u8(adsr[2] | 0.0f);
+        patch->release_ms = min<uint32_t>(adsr[3] | 0u, UINT16_MAX);
+    }
+
+    JsonArrayConst notes = doc["notes"];
+    if (notes.isNull() || notes.size() == 0) {
+        *error = "notes must be a non-empty array";
+        return false;
+    }
+    if (notes.size() > TONE_MAX_NOTES) {
+        *error = "too many notes";
+        return false;
+    }
+
+    for (JsonArrayConst note : notes) {
+        ToneNote& n = patch->notes[patch->count];
+        if (note.size() < 2 || !parse_pitch(note[0], &n.hz) || !note[1].is<uint32_t>()) {
+            *error = "a note is [pitch, ms] or [pitch, ms, level]";
+            return false;
+        }
+        n.ms = min<uint32_t>(note[1].as<uint32_t>(), UINT16_MAX);
+        n.level = note.size() > 2 ? unit_to_u8(note[2] | 1.0f) : 255;
+        patch->count++;
+    }
+    return true;
+}
+
+bool tone_parse_json(const char* json, size_t len, TonePatch* patch, const char** error) {
+    JsonArena arena(toneArena, sizeof(toneArena));
+    JsonDocument doc(&arena);
+    DeserializationError err = deserializeJson(doc, json, len);
+    if (err == DeserializationError::NoMemory || arena.overflowed()) {
+        *error = "Tone patch too large";
+        return false;
+    }
+    if (err) {
+        *error = "Invalid JSON";
+        return false;
+    }
+    return tone_parse(doc.as<JsonVariantConst>(), patch, error);
+}
+
+bool tone_load(const char* name, TonePatch* patch, const char** error) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s%s%s", name[0] == '/' ? "" : "/", name, TONE_FILE_EXT);
+
+    File f = LittleFS.open(path, "r");
+    if (!f) {
+        *error = "Tone not found";
+        return false;
+    }
+    size_t size = f.size();
+    if (size > TONE_FILE_MAX_BYTES) {
+        f.close();
+        *error = "Tone file too large";
+        return false;
+    }
+
+    size_t got = f.read((uint8_t*)toneFile, size);
+    f.close();
+    if (got != size) {
+        *error = "Tone file read failed";
+        return false;
+    }
+    return tone_parse_json(toneFile, size, patch, error);
+}
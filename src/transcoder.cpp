@@ -0,0 +1,620 @@
+#include "transcoder.h"
+#include "json_out.h"
+#include "config.h"
+#include <LittleFS.h>
+#include <math.h>
+
+#ifndef TRANSCODE_SCAN_ON_BOOT
+#define TRANSCODE_SCAN_ON_BOOT 0 // rewrites files in place, so only on request
+#endif
+
+static constexpr uint32_t OUT_RATE = AudioPlayer::SAMPLE_RATE;
+static constexpr uint32_t TASK_STACK_SIZE = 6144;
+static constexpr UBaseType_t TASK_PRIORITY = 1;      // below the player (2)
+static constexpr uint32_t YIELD_POLL_MS = 200;
+
+static constexpr size_t IN_BUF_BYTES = 2048;
+static constexpr size_t OUT_BUF_FRAMES = 512;
+static constexpr size_t WAV_HEADER_SIZE = 44;
+static constexpr int MAX_CHANNELS = 8;
+static constexpr int MAX_BOX = 8;                    // anti-alias average, up to 8x downsampling
+
+// Loudness: RMS over 50 ms blocks, ignoring blocks below -50 dBFS so pauses
+// do not pull the gain up. Trimming cuts below -50 dBFS, keeping a 10 ms pad
+// and a 5 ms ramp at each cut.
+static constexpr uint32_t LOUDNESS_BLOCK_FRAMES = OUT_RATE / 20;
+static constexpr int32_t GATE_LEVEL = 104;           // -50 dBFS
+static constexpr int32_t TRIM_LEVEL = 104;
+static constexpr uint32_t TRIM_PAD_FRAMES = OUT_RATE / 100;
+static constexpr uint32_t TRIM_RAMP_FRAMES = OUT_RATE / 200;
+static constexpr int32_t PEAK_LIMIT = 32000;         // normalization never clips
+
+static constexpr uint16_t WAVE_FORMAT_PCM = 1;
+static constexpr uint16_t WAVE_FORMAT_FLOAT = 3;
+static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+struct WavInfo {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t bits;
+    size_t dataOffset;
+    size_t dataSize;
+};
+
+// Downmix -> box filter -> linear interpolation, all in 16-bit range.
+struct Resampler {
+    uint32_t step;          // input frames per output frame, Q16
+    uint32_t pos;           // next output between prev and the next input, Q16
+    int32_t prev;
+    bool primed;
+    uint8_t boxLen;
+    uint8_t boxIdx;
+    int32_t boxSum;
+    int32_t box[MAX_BOX];
+};
+
+struct Analysis {
+    uint32_t frames;
+    int32_t peak;
+    uint32_t first;         // first and last frame above TRIM_LEVEL
+    uint32_t last;
+    bool audible;
+    uint64_t blockSumSq;
+    uint32_t blockFrames;
+    uint64_t gatedSumSq;
+    uint32_t gatedFrames;
+};
+
+struct Writer {
+    File* out;
+    uint32_t index;         // output frame, before trimming
+    uint32_t start;
+    uint32_t end;
+    int32_t gainQ12;
+    bool rampIn;
+    bool rampOut;
+    int16_t buf[OUT_BUF_FRAMES];
+    size_t fill;
+    uint32_t written;
+    bool ok;
+};
+
+static AudioPlayer* audioPlayer = nullptr;
+static TaskHandle_t task = nullptr;
+static StaticTask_t taskBuffer;
+static StackType_t taskStack[TASK_STACK_SIZE];
+
+// Owned by the worker task.
+static uint8_t inBuf[IN_BUF_BYTES];
+
+// The job table is read by HTTP handlers and written by the worker.
+static portMUX_TYPE jobsMux = portMUX_INITIALIZER_UNLOCKED;
+static TranscodeJob jobs[TRANSCODE_MAX_JOBS];
+static uint16_t nextId = 1;
+
+// -----------------------------------------------------------------------------
+// Job table
+// -----------------------------------------------------------------------------
+
+// Caller holds jobsMux.
+static TranscodeJob* find_job(uint16_t id) {
+    for (TranscodeJob& job : jobs) {
+        if (job.id && job.id == id) return &job;
+    }
+    return nullptr;
+}
+
+uint16_t transcoder_enqueue(const char* src, const char* dst) {
+    // Room for the ".tmp" suffix of the output.
+    if (strlen(src) >= TRANSCODE_PATH_LEN || strlen(dst) + 4 >= TRANSCODE_PATH_LEN) return 0;
+
+    uint16_t id = 0;
+    portENTER_CRITICAL(&jobsMux);
+    // A free slot, or else the oldest finished job.
+    TranscodeJob* slot = nullptr;
+    for (TranscodeJob& job : jobs) {
+        if (!job.id) {
+            slot = &job;
+            break;
+        }
+        bool finished = job.state == JobState::Done || job.state == JobState::Failed;
+        if (finished && (!slot || job.id < slot->id)) slot = &job;
+    }
+    if (slot) {
+        memset(slot, 0, sizeof(*slot));
+        id = nextId++;
+        if (nextId == 0) nextId = 1;
+        slot->id = id;
+        slot->state = JobState::Queued;
+        strlcpy(slot->src, src, sizeof(slot->src));
+        strlcpy(slot->dst, dst, sizeof(slot->dst));
+    }
+    portEXIT_CRITICAL(&jobsMux);
+
+    if (id && task) xTaskNotifyGive(task);
+    return id;
+}
+
+// Oldest queued job; copies it out so the worker can use it without the lock.
+static bool next_job(TranscodeJob* job) {
+    portENTER_CRITICAL(&jobsMux);
+    TranscodeJob* next = nullptr;
+    for (TranscodeJob& j : jobs) {
+        if (j.id && j.state == JobState::Queued && (!next || j.id < next->id)) next = &j;
+    }
+    if (next) *job = *next;
+    portEXIT_CRITICAL(&jobsMux);
+    return next != nullptr;
+}
+
+// Publishes the worker's copy of a job.
+static void update_job(const TranscodeJob& job) {
+    portENTER_CRITICAL(&jobsMux);
+    TranscodeJob* slot = find_job(job.id);
+    if (slot) *slot = job;
+    portEXIT_CRITICAL(&jobsMux);
+}
+
+// -----------------------------------------------------------------------------
+// WAV input
+// -----------------------------------------------------------------------------
+
+static uint16_t read_u16(const uint8_t* p) { return p[0] | p[1] << 8; }
+static uint32_t read_u32(const uint8_t* p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+static bool read_wav_info(File& f, WavInfo* info, const char** error) {
+    memset(info, 0, sizeof(*info));
+    size_t fileSize = f.size();
+
+    uint8_t riff[12];
+    if (f.read(riff, sizeof(riff)) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        *error = "not a RIFF/WAVE file";
+        return false;
+    }
+
+    bool haveFmt = false;
+    size_t pos = sizeof(riff);
+    uint8_t chunk[8];
+    while (pos + sizeof(chunk) <= fileSize) {
+        f.seek(pos);
+        if (f.read(chunk, sizeof(chunk)) != sizeof(chunk)) break;
+        uint32_t chunkSize = read_u32(chunk + 4);
+        pos += sizeof(chunk);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+            uint8_t fmt[40];
+            size_t n = f.read(fmt, min<size_t>(chunkSize, sizeof(fmt)));
+            if (n < 16) break;
+            info->format = read_u16(fmt);
+            info->channels = read_u16(fmt + 2);
+            info->rate = read_u32(fmt + 4);
+            info->bits = read_u16(fmt + 14);
+            // WAVE_FORMAT_EXTENSIBLE: the real format is the first two bytes
+            // of the SubFormat GUID.
+            if (info->format == WAVE_FORMAT_EXTENSIBLE && n >= 26) info->format = read_u16(fmt + 24);
+            haveFmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            info->dataOffset = pos;
+            info->dataSize = min<size_t>(chunkSize, fileSize - pos);
+            break;
+        }
+        pos += chunkSize + (chunkSize & 1);
+    }
+
+    if (!haveFmt || !info->dataOffset) {
+        *error = "missing fmt or data chunk";
+        return false;
+    }
+    bool pcm = info->format == WAVE_FORMAT_PCM &&
+               (info->bits == 8 || info->bits == 16 || info->bits == 24 || info->bits == 32);
+    bool flt = info->format == WAVE_FORMAT_FLOAT && info->bits == 32;
+    if (!pcm && !flt) {
+        *error = "unsupported sample format";
+        return false;
+    }
+    if (info->channels < 1 || info->channels > MAX_CHANNELS) {
+        *error = "unsupported channel count";
+        return false;
+    }
+    if (info->rate < 4000 || info->rate > OUT_RATE * MAX_BOX) {
+        *error = "unsupported sample rate";
+        return false;
+    }
+    return true;
+}
+
+static bool is_native(const WavInfo& w) {
+    return w.format == WAVE_FORMAT_PCM && w.channels == 1 && w.bits == 16 && w.rate == OUT_RATE;
+}
+
+static int32_t decode_sample(const uint8_t* p, const WavInfo& w) {
+    switch (w.bits) {
+        case 8:  return ((int32_t)p[0] - 128) << 8;
+        case 16: return (int16_t)read_u16(p);
+        case 24: return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 16;
+        default:
+            if (w.format == WAVE_FORMAT_FLOAT) {
+                float f;
+                memcpy(&f, p, sizeof(f));
+                return (int32_t)lrintf(constrain(f, -1.0f, 1.0f) * 32767.0f);
+            }
+            return (int32_t)read_u32(p) >> 16;
+    }
+}
+
+static void resampler_init(Resampler* r, uint32_t inRate) {
+    memset(r, 0, sizeof(*r));
+    r->step = (uint32_t)(((uint64_t)inRate << 16) / OUT_RATE);
+    r->boxLen = inRate > OUT_RATE ? (uint8_t)min<uint32_t>((inRate + OUT_RATE - 1) / OUT_RATE, MAX_BOX) : 1;
+}
+
+// Feeds one mono input sample; calls sink(y) for every output sample.
+template <typename Sink>
+static void resampler_push(Resampler* r, int32_t x, Sink& sink) {
+    r->boxSum += x - r->box[r->boxIdx];
+    r->box[r->boxIdx] = x;
+    r->boxIdx = (r->boxIdx + 1) % r->boxLen;
+    x = r->boxSum / r->boxLen;
+
+    if (!r->primed) {
+        r->prev = x;
+        r->primed = true;
+        return;
+    }
+    while (r->pos < 0x10000) {
+        sink(r->prev + (int32_t)(((int64_t)(x - r->prev) * r->pos) >> 16));
+        r->pos += r->step;
+    }
+    r->pos -= 0x10000;
+    r->prev = x;
+}
+
+// -----------------------------------------------------------------------------
+// Worker
+// -----------------------------------------------------------------------------
+
+static bool player_busy() {
+    return audioPlayer && (audioPlayer->isPlaying() || audioPlayer->isStreaming() || audioPlayer->isRtpActive());
+}
+
+// Blocks while anything is playing. Flash writes stall cache-mapped reads,
+// and the sound bank plays straight from flash.
+static uint32_t wait_for_idle() {
+    uint32_t waitedMs = 0;
+    while (player_busy()) {
+        vTaskDelay(pdMS_TO_TICKS(YIELD_POLL_MS));
+        waitedMs += YIELD_POLL_MS;
+    }
+    return waitedMs;
+}
+
+// Wraps every flash write, not just one per input chunk: a play can start at
+// any point in a pass, and the output buffer fills mid-chunk. The player's
+// flash gate is held from the idle check to the end of the write, so a play
+// cannot start in between; it waits for this one write instead.
+static void begin_write(TranscodeJob& job) {
+    if (!audioPlayer) return;
+    while (!audioPlayer->beginFlashWrite()) job.yielded_ms += wait_for_idle();
+}
+
+static void end_write() {
+    if (audioPlayer) audioPlayer->endFlashWrite();
+}
+
+// One pass over the PCM data. Progress runs from `fromPct` to `fromPct + 50`.
+template <typename Sink>
+static bool stream_pass(File& f, const WavInfo& w, TranscodeJob& job, uint8_t fromPct, Sink& sink) {
+    size_t frameBytes = w.channels * (w.bits / 8);
+    size_t chunkBytes = IN_BUF_BYTES / frameBytes * frameBytes;
+    size_t done = 0;
+
+    Resampler r;
+    resampler_init(&r, w.rate);
+    f.seek(w.dataOffset);
+
+    while (done + frameBytes <= w.dataSize) {
+        job.yielded_ms += wait_for_idle();
+
+        size_t want = min(chunkBytes, (w.dataSize - done) / frameBytes * frameBytes);
+        size_t got = f.read(inBuf, want);
+        if (got < frameBytes) {
+            job.error = "read error";
+            return false;
+        }
+        got -= got % frameBytes;
+
+        for (size_t off = 0; off < got; off += frameBytes) {
+            int32_t sum = 0;
+            for (int c = 0; c < w.channels; c++) sum += decode_sample(inBuf + off + c * (w.bits / 8), w);
+            resampler_push(&r, sum / w.channels, sink);
+        }
+        done += got;
+
+        uint8_t pct = fromPct + (uint8_t)((uint64_t)done * 50 / w.dataSize);
+        if (pct != job.progress_pct) {
+            job.progress_pct = pct;
+            update_job(job);
+        }
+        taskYIELD();
+    }
+    return true;
+}
+
+static void write_header(File& out, uint32_t frames, TranscodeJob& job) {
+    uint8_t h[WAV_HEADER_SIZE];
+    uint32_t dataBytes = frames * sizeof(int16_t);
+    auto put16 = [&](size_t at, uint16_t v) { h[at] = v; h[at + 1] = v >> 8; };
+    auto put32 = [&](size_t at, uint32_t v) { put16(at, v); put16(at + 2, v >> 16); };
+
+    memcpy(h, "RIFF", 4);
+    put32(4, 36 + dataBytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, WAVE_FORMAT_PCM);
+    put16(22, 1);
+    put32(24, OUT_RATE);
+    put32(28, OUT_RATE * sizeof(int16_t));
+    put16(32, sizeof(int16_t));
+    put16(34, 16);
+    memcpy(h + 36, "data", 4);
+    put32(40, dataBytes);
+
+    begin_write(job);
+    out.seek(0);
+    out.write(h, sizeof(h));
+    end_write();
+}
+
+static void flush_writer(Writer& w, TranscodeJob& job) {
+    if (!w.fill || !w.ok) return;
+    size_t bytes = w.fill * sizeof(int16_t);
+    begin_write(job);
+    if (w.out->write((const uint8_t*)w.buf, bytes) != bytes) w.ok = false;
+    end_write();
+    w.written += w.fill;
+    w.fill = 0;
+}
+
+static void run_job(TranscodeJob& job, uint32_t startedMs) {
+    char tmp[TRANSCODE_PATH_LEN + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", job.dst);
+
+    File in = LittleFS.open(job.src, "r");
+    if (!in) {
+        job.error = "source not found";
+        return;
+    }
+
+    WavInfo w;
+    if (!read_wav_info(in, &w, &job.error)) return;
+    job.in_rate = w.rate;
+    job.in_channels = w.channels;
+    job.in_bits = w.bits;
+    job.in_float = w.format == WAVE_FORMAT_FLOAT;
+
+    // Pass 1: level, loudness and silence.
+    job.state = JobState::Analyzing;
+    update_job(job);
+
+    Analysis a{};
+    auto analyze = [&](int32_t y) {
+        int32_t mag = abs(y);
+        if (mag > a.peak) a.peak = mag;
+        if (mag > TRIM_LEVEL) {
+            if (!a.audible) a.first = a.frames;
+            a.last = a.frames;
+            a.audible = true;
+        }
+        a.blockSumSq += (int64_t)y * y;
+        if (++a.blockFrames == LOUDNESS_BLOCK_FRAMES) {
+            if (a.blockSumSq >= (uint64_t)GATE_LEVEL * GATE_LEVEL * a.blockFrames) {
+                a.gatedSumSq += a.blockSumSq;
+                a.gatedFrames += a.blockFrames;
+            }
+            a.blockSumSq = 0;
+            a.blockFrames = 0;
+        }
+        a.frames++;
+    };
+    if (!stream_pass(in, w, job, 0, analyze)) return;
+    if (a.blockFrames && a.blockSumSq >= (uint64_t)GATE_LEVEL * GATE_LEVEL * a.blockFrames) {
+        a.gatedSumSq += a.blockSumSq;
+        a.gatedFrames += a.blockFrames;
+    }
+    if (!a.audible) {
+        job.error = "clip is silent";
+        return;
+    }
+
+    uint32_t start = a.first > TRIM_PAD_FRAMES ? a.first - TRIM_PAD_FRAMES : 0;
+    uint32_t end = min(a.last + 1 + TRIM_PAD_FRAMES, a.frames);
+
+    float gain = 1.0f;
+    if (a.gatedFrames) {
+        float rms = sqrtf((float)(a.gatedSumSq / a.gatedFrames));
+        gain = 32767.0f * powf(10.0f, TRANSCODE_TARGET_DBFS / 20.0f) / rms;
+    }
+    gain = min(gain, powf(10.0f, TRANSCODE_MAX_GAIN_DB / 20.0f));
+    gain = min(gain, (float)PEAK_LIMIT / a.peak);
+    job.gain_db = 20.0f * log10f(gain);
+    job.out_frames = end - start;
+    job.trimmed_ms = (uint32_t)((uint64_t)(a.frames - job.out_frames) * 1000 / OUT_RATE);
+
+    size_t outBytes = WAV_HEADER_SIZE + (size_t)job.out_frames * sizeof(int16_t);
+    if (LittleFS.totalBytes() - LittleFS.usedBytes() < outBytes + 4096) {
+        job.error = "not enough free space";
+        return;
+    }
+
+    // Pass 2: the same pipeline again, written out trimmed and scaled.
+    job.state = JobState::Converting;
+    update_job(job);
+
+    begin_write(job);
+    File out = LittleFS.open(tmp, "w");
+    end_write();
+    if (!out) {
+        job.error = "cannot create output";
+        return;
+    }
+    write_header(out, 0, job);
+
+    static Writer wr; // too big for the task stack with its 512-frame buffer
+    wr.out = &out;
+    wr.index = 0;
+    wr.start = start;
+    wr.end = end;
+    wr.gainQ12 = (int32_t)lrintf(gain * 4096);
+    wr.rampIn = start > 0;
+    wr.rampOut = end < a.frames;
+    wr.fill = 0;
+    wr.written = 0;
+    wr.ok = true;
+
+    auto write = [&](int32_t y) {
+        uint32_t k = wr.index++;
+        if (k < wr.start || k >= wr.end) return;
+        int32_t v = (int32_t)(((int64_t)y * wr.gainQ12) >> 12);
+        uint32_t fromStart = k - wr.start, toEnd = wr.end - 1 - k;
+        if (wr.rampIn && fromStart < TRIM_RAMP_FRAMES) v = v * (int32_t)fromStart / (int32_t)TRIM_RAMP_FRAMES;
+        if (wr.rampOut && toEnd < TRIM_RAMP_FRAMES) v = v * (int32_t)toEnd / (int32_t)TRIM_RAMP_FRAMES;
+        wr.buf[wr.fill++] = (int16_t)constrain(v, -32768, 32767);
+        if (wr.fill == OUT_BUF_FRAMES) flush_writer(wr, job);
+    };
+    bool ok = stream_pass(in, w, job, 50, write);
+    in.close();
+    flush_writer(wr, job);
+    if (ok && wr.ok) write_header(out, wr.written, job);
+    begin_write(job); // close() commits the file's metadata
+    out.close();
+    end_write();
+
+    if (!ok || !wr.ok) {
+        if (!job.error) job.error = "write error";
+        begin_write(job);
+        LittleFS.remove(tmp);
+        end_write();
+        return;
+    }
+
+    // littlefs replaces an existing destination atomically, so a reader sees
+    // either the old file or the new one.
+    begin_write(job);
+    bool renamed = LittleFS.rename(tmp, job.dst);
+    if (!renamed) LittleFS.remove(tmp);
+    end_write();
+    if (!renamed) {
+        job.error = "rename failed";
+        return;
+    }
+
+    job.out_frames = wr.written;
+    Serial.printf("Transcoded %s -> %s: %lu Hz x%u -> %lu frames, %.1f dB, %lu ms trimmed, %lu ms\n",
+                  job.src, job.dst, (unsigned long)job.in_rate, job.in_channels,
+                  (unsigned long)job.out_frames, job.gain_db, (unsigned long)job.trimmed_ms,
+                  (unsigned long)(millis() - startedMs));
+}
+
+static bool has_wav_extension(const char* name) {
+    size_t len = strlen(name);
+    return len >= 4 && strcasecmp(name + len - 4, ".wav") == 0;
+}
+
+// Files put on LittleFS in another format (uploadfs, or a future upload
+// endpoint) are converted in place.
+static void scan_root() {
+    File dir = LittleFS.open("/");
+    if (!dir || !dir.isDirectory()) return;
+
+    char path[TRANSCODE_PATH_LEN];
+    File file = dir.openNextFile();
+    while (file) {
+        if (!file.isDirectory() && has_wav_extension(file.name())) {
+            WavInfo w;
+            const char* error;
+            snprintf(path, sizeof(path), "/%s", file.name());
+            if (read_wav_info(file, &w, &error) && !is_native(w)) {
+                uint16_t id = transcoder_enqueue(path, path);
+                Serial.printf("Transcode queued: %s (%lu Hz x%u, %u bit) -> job %u\n",
+                              path, (unsigned long)w.rate, w.channels, w.bits, id);
+            }
+        }
+        file = dir.openNextFile();
+    }
+}
+
+static void task_entry(void*) {
+    if (TRANSCODE_SCAN_ON_BOOT) {
+        wait_for_idle();
+        scan_root();
+    }
+
+    TranscodeJob job;
+    for (;;) {
+        if (!next_job(&job)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        uint32_t startedMs = millis();
+        job.error = nullptr;
+        run_job(job, startedMs);
+        job.elapsed_ms = millis() - startedMs;
+        job.state = job.error ? JobState::Failed : JobState::Done;
+        if (!job.error) job.progress_pct = 100;
+        else Serial.printf("Transcode %s failed: %s\n", job.src, job.error);
+        update_job(job);
+    }
+}
+
+void transcoder_init(AudioPlayer& player) {
+    if (task) return;
+    audioPlayer = &player;
+    task = xTaskCreateStatic(task_entry, "Transcode", TASK_STACK_SIZE, nullptr, TASK_PRIORITY, taskStack, &taskBuffer);
+    if (!task) Serial.println("Transcoder: task creation failed");
+}
+
+// -----------------------------------------------------------------------------
+// Status
+// -----------------------------------------------------------------------------
+
+const char* transcoder_state_name(JobState state) {
+    switch (state) {
+        case JobState::Queued:     return "queued";
+        case JobState::Analyzing:  return "analyzing";
+        case JobState::Converting: return "converting";
+        case JobState::Done:       return "done";
+        case JobState::Failed:     return "failed";
+    }
+    return "unknown";
+}
+
+size_t transcoder_jobs_json(char* out, size_t len) {
+    TranscodeJob snapshot[TRANSCODE_MAX_JOBS];
+    portENTER_CRITICAL(&jobsMux);
+    memcpy(snapshot, jobs, sizeof(snapshot));
+    portEXIT_CRITICAL(&jobsMux);
+
+    JsonOut json{out, len, 0, false};
+    json.add("{\"busy\":%s,\"jobs\":[", player_busy() ? "true" : "false");
+    bool first = true;
+    for (const TranscodeJob& job : snapshot) {
+        if (!job.id) continue;
+        json.add("%s{\"id\":%u,\"state\":\"%s\",\"progress_pct\":%u,\"src\":\"%s\",\"dst\":\"%s\","
+                 "\"in_rate\":%lu,\"in_channels\":%u,\"in_bits\":%u,\"in_float\":%s,"
+                 "\"out_frames\":%lu,\"gain_db\":%.1f,\"trimmed_ms\":%lu,\"elapsed_ms\":%lu,"
+                 "\"yielded_ms\":%lu",
+                 first ? "" : ",", job.id, transcoder_state_name(job.state), job.progress_pct,
+                 job.src, job.dst, (unsigned long)job.in_rate, job.in_channels, job.in_bits,
+                 job.in_float ? "true" : "false", (unsigned long)job.out_frames, job.gain_db,
+                 (unsigned long)job.trimmed_ms, (unsigned long)job.elapsed_ms,
+                 (unsigned long)job.yielded_ms);
+        if (job.error) json.add(",\"error\":\"%s\"", job.error);
+        json.add("}");
+        first = false;
+    }
+    json.add("]}");
+    return json.overflow ? 0 : json.len;
+}
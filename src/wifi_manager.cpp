@@ -1,5 +1,28 @@
 #include "wifi_manager.h"
 #include "config.h"
+#include "energy.h"
+#include <esp_wifi.h>
+#include <freertos/timers.h>
+
+// Defaults for config.h files written before the reconnect manager.
+#ifndef WIFI_BACKOFF_MIN_MS
+#define WIFI_BACKOFF_MIN_MS       1000
+#endif
+#ifndef WIFI_BACKOFF_MAX_MS
+#define WIFI_BACKOFF_MAX_MS       (60 * 1000)
+#endif
+#ifndef WIFI_ATTEMPT_TIMEOUT_MS
+#define WIFI_ATTEMPT_TIMEOUT_MS   (15 * 1000)
+#endif
+#ifndef WIFI_FAST_RECONNECT_TRIES
+#define WIFI_FAST_RECONNECT_TRIES 3
+#endif
+#ifndef WIFI_REBOOT_BUDGET_MS
+#define WIFI_REBOOT_BUDGET_MS     (30 * 60 * 1000UL)
+#endif
+
+static constexpr uint32_t RETRY_TASK_STACK_SIZE = 3072;
+static constexpr UBaseType_t RETRY_TASK_PRIORITY = 1;
 
 IPAddress local_IP(LOCAL_IP); // Set a static IP address
 IPAddress gateway(GATEWAY);
@@ -7,47 +30,217 @@ IPAddress subnet(SUBNET);
 IPAddress dns1(DNS1);
 IPAddress dns2(DNS2);
 
-void wifi_init() {
-    WiFi.disconnect(true);
-    delay(800);
-    WiFi.mode(WIFI_STA);
-    delay(200);
+// Last good access point. Kept in RTC memory so the first connection after
+// deep sleep can skip the scan as well.
+RTC_DATA_ATTR static uint8_t savedBssid[6];
+RTC_DATA_ATTR static int32_t savedChannel = 0;
 
-    #ifdef USE_STATIC_IP
-        WiFi.config(local_IP, gateway, subnet, dns1, dns2);
-    #endif
+// Updated from the Wi-Fi event task and the retry task, read by HTTP.
+static portMUX_TYPE wifiMux = portMUX_INITIALIZER_UNLOCKED;
+static WifiStats stats;
+static bool everConnected = false;
+static unsigned long initMs = 0;
+static unsigned long downSinceMs = 0;
+static unsigned long nextAttemptAtMs = 0;
+static uint32_t backoffMs = WIFI_BACKOFF_MIN_MS;
 
-    Serial.print("Connecting to WiFi...\n");
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+// The one-shot timer only wakes retryTask: WiFi.begin(), disconnect, logging
+// and a reboot are too heavy for the timer service task, which every other
+// software timer shares.
+static TimerHandle_t retryTimer = nullptr;
+static TaskHandle_t retryTask = nullptr;
+static StaticTask_t retryTaskBuffer;
+static StackType_t retryTaskStack[RETRY_TASK_STACK_SIZE];
 
-    unsigned long start = millis();
-    while (true) {
-        wl_status_t st = WiFi.status();
+static void schedule(uint32_t delayMs) {
+    if (!retryTimer) return;
+    xTimerChangePeriod(retryTimer, pdMS_TO_TICKS(max<uint32_t>(delayMs, 1)), 0);
+}
+
+// Caller holds wifiMux.
+static uint32_t next_backoff() {
+    uint32_t delayMs = backoffMs;
+    backoffMs = min<uint32_t>(backoffMs * 2, WIFI_BACKOFF_MAX_MS);
+    nextAttemptAtMs = millis() + delayMs;
+    stats.state = WifiState::Backoff;
+    return delayMs;
+}
+
+static void start_attempt() {
+    unsigned long now = millis();
+    uint32_t attempt;
+    bool fast;
+
+    portENTER_CRITICAL(&wifiMux);
+    if (WIFI_REBOOT_BUDGET_MS > 0 && now - downSinceMs > (unsigned long)WIFI_REBOOT_BUDGET_MS) {
+        portEXIT_CRITICAL(&wifiMux);
+        Serial.println("WiFi reconnect budget exhausted → reboot");
+        ESP.restart();
+        return;
+    }
+    stats.state = WifiState::Connecting;
+    attempt = ++stats.attempts;
+    fast = savedChannel > 0 && attempt <= WIFI_FAST_RECONNECT_TRIES;
+    if (fast) stats.fast_attempts++;
+    nextAttemptAtMs = 0;
+    portEXIT_CRITICAL(&wifiMux);
+
+    if (fast) {
+        // Straight to the last AP on its channel, no scan.
+        Serial.printf("WiFi attempt %lu (channel %ld)\n", (unsigned long)attempt, (long)savedChannel);
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD, savedChannel, savedBssid);
+    } else {
+        Serial.printf("WiFi attempt %lu (scan)\n", (unsigned long)attempt);
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    }
+    schedule(WIFI_ATTEMPT_TIMEOUT_MS);
+}
+
+static void on_retry_timer(TimerHandle_t) {
+    xTaskNotifyGive(retryTask);
+}
+
+// Runs when the timer expires: starts the next attempt after a backoff, or
+// abandons an attempt that produced neither an IP nor a disconnect event.
+static void retry() {
+    portENTER_CRITICAL(&wifiMux);
+    WifiState state = stats.state;
+    uint32_t delayMs = 0;
+    if (state == WifiState::Connecting) delayMs = next_backoff();
+    portEXIT_CRITICAL(&wifiMux);
+
+    if (state == WifiState::Backoff) {
+        start_attempt();
+    } else if (state == WifiState::Connecting) {
+        Serial.println("WiFi attempt timed out");
+        WiFi.disconnect(false);
+        schedule(delayMs);
+    }
+}
+
+static void retry_task(void*) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        retry();
+    }
+}
+
+// Without the timer or the task nothing would ever retry, so the driver's
+// own reconnect takes over instead.
+static bool create_retry() {
+    retryTask = xTaskCreateStatic(retry_task, "WiFiRetry", RETRY_TASK_STACK_SIZE, nullptr,
+                                  RETRY_TASK_PRIORITY, retryTaskStack, &retryTaskBuffer);
+    if (!retryTask) {
+        Serial.println("WiFi: retry task creation failed, using driver auto-reconnect");
+        return false;
+    }
+    retryTimer = xTimerCreate("wifiRetry", pdMS_TO_TICKS(WIFI_BACKOFF_MIN_MS), pdFALSE, nullptr, on_retry_timer);
+    if (!retryTimer) {
+        Serial.println("WiFi: retry timer creation failed, using driver auto-reconnect");
+        return false;
+    }
+    return true;
+}
+
+static void on_wifi_event(arduino_event_id_t event, arduino_event_info_t info) {
+    unsigned long now = millis();
 
-        if (st == WL_CONNECTED) break;
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        if (retryTimer) xTimerStop(retryTimer, 0);
 
-        if (st == WL_NO_SSID_AVAIL || st == WL_CONNECT_FAILED) {
-            Serial.println("Retrying WiFi...\n");
-            WiFi.disconnect(false);
-            delay(500);
-            WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+        portENTER_CRITICAL(&wifiMux);
+        if (!everConnected) {
+            stats.boot_connect_ms = now - initMs;
+        } else {
+            stats.reconnects++;
+            stats.last_reconnect_ms = now - downSinceMs;
+            stats.max_reconnect_ms = max(stats.max_reconnect_ms, stats.last_reconnect_ms);
         }
+        everConnected = true;
+        stats.state = WifiState::Connected;
+        backoffMs = WIFI_BACKOFF_MIN_MS;
+        nextAttemptAtMs = 0;
+        portEXIT_CRITICAL(&wifiMux);
+
+        energy_set(ENERGY_WIFI_UP, true);
+        memcpy(savedBssid, WiFi.BSSID(), sizeof(savedBssid));
+        savedChannel = WiFi.channel();
+        Serial.printf("WiFi connected. IP: %s, channel %ld\n",
+                      WiFi.localIP().toString().c_str(), (long)savedChannel);
+        return;
+    }
+
+    if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        uint8_t reason = info.wifi_sta_disconnected.reason;
 
-        if (millis() - start > WIFI_CONNECT_TIMEOUT_MS) {
-            Serial.println("WiFi connect timeout → restart");
-            WiFi.disconnect(true);
-            delay(2000);
-            ESP.restart();
+        portENTER_CRITICAL(&wifiMux);
+        stats.last_reason = reason;
+        bool wasConnected = stats.state == WifiState::Connected;
+        if (wasConnected) {
+            stats.disconnects++;
+            stats.attempts = 0;
+            stats.fast_attempts = 0;
+            downSinceMs = now;
         }
+        // A disconnect while already backing off is the echo of our own
+        // WiFi.disconnect(); the retry is scheduled.
+        uint32_t delayMs = stats.state == WifiState::Backoff ? 0 : next_backoff();
+        portEXIT_CRITICAL(&wifiMux);
 
-        delay(500);
+        if (wasConnected) {
+            energy_set(ENERGY_WIFI_UP, false);
+            Serial.printf("WiFi lost (reason %u)\n", reason);
+        }
+        if (delayMs) schedule(delayMs);
     }
+}
+
+void wifi_init() {
+    bool managed = create_retry();
+
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(!managed); // reconnects are ours when we can schedule them
+    WiFi.onEvent(on_wifi_event);
+    WiFi.mode(WIFI_STA);
+
+    #ifdef USE_STATIC_IP
+        WiFi.config(local_IP, gateway, subnet, dns1, dns2);
+    #endif
 
-    Serial.println();
-    Serial.print("Connected. IP: ");
-    Serial.println(WiFi.localIP());
+    initMs = millis();
+    downSinceMs = initMs;
+    Serial.print("Connecting to WiFi...\n");
+    start_attempt();
+}
+
+bool wifi_wait_connected(uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (!wifi_is_connected() && millis() - start < timeoutMs) {
+        delay(100);
+    }
+    return wifi_is_connected();
 }
 
 bool wifi_is_connected() {
     return WiFi.status() == WL_CONNECTED;
 }
+
+WifiStats wifi_get_stats() {
+    unsigned long now = millis();
+
+    portENTER_CRITICAL(&wifiMux);
+    WifiStats s = stats;
+    if (s.state != WifiState::Connected) s.down_ms = now - downSinceMs;
+    if (nextAttemptAtMs) s.next_attempt_ms = (int32_t)(nextAttemptAtMs - now) > 0 ? nextAttemptAtMs - now : 0;
+    portEXIT_CRITICAL(&wifiMux);
+    return s;
+}
+
+const char* wifi_state_name(WifiState state) {
+    switch (state) {
+        case WifiState::Connecting: return "connecting";
+        case WifiState::Connected:  return "connected";
+        case WifiState::Backoff:    return "backoff";
+    }
+    return "unknown";
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Round-trip latency of the control paths: per-request GETs vs /batch vs /ws.
+
+Each round issues the same command set (ping, status, battery) three ways:
+  get    one HTTP GET per command, new TCP connection each time
+  batch  a single POST /batch carrying all commands
+  ws     binary pings over one persistent WebSocket, plus a text batch
+
+Usage:
+    python tools/bench_control.py 192.168.1.63 --rounds 50
+"""
+
+import argparse
+import base64
+import json
+import os
+import socket
+import statistics
+import struct
+import time
+import urllib.request
+
+COMMANDS = ["ping", "status", "battery"]
+OP_PING = 0x01
+
+
+def http_get(host, path):
+    with urllib.request.urlopen("http://%s%s" % (host, path), timeout=10) as resp:
+        return resp.read()
+
+
+def http_batch(host, commands):
+    body = json.dumps([{"cmd": c} for c in commands]).encode()
+    req = urllib.request.Request("http://%s/batch" % host, data=body, method="POST",
+                                 headers={"Content-Type": "application/json"})
+    with urllib.request.urlopen(req, timeout=10) as resp:
+        return json.loads(resp.read())
+
+
+class WebSocket:
+    """Minimal RFC 6455 client: unfragmented frames, no extensions."""
+
+    def __init__(self, host, path="/ws", port=80):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((
+            "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+            "Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n" % (path, host, key)).encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError("handshake failed")
+            response += chunk
+        if b" 101 " not in response.split(b"\r\n", 1)[0]:
+            raise ConnectionError(response.split(b"\r\n", 1)[0].decode())
+
+    def send(self, payload, opcode):
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        n = len(payload)
+        if n < 126:
+            header += bytes([0x80 | n])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", n)
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def _read(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("closed")
+            data += chunk
+        return data
+
+    def recv(self):
+        b0, b1 = self._read(2)
+        n = b1 & 0x7F
+        if n == 126:
+            n = struct.unpack(">H", self._read(2))[0]
+        elif n == 127:
+            n = struct.unpack(">Q", self._read(8))[0]
+        return b0 & 0x0F, self._read(n)
+
+    def close(self):
+        self.sock.close()
+
+
+def timed(fn):
+    start = time.perf_counter()
+    fn()
+    return (time.perf_counter() - start) * 1000.0
+
+
+def summary(name, samples):
+    samples = sorted(samples)
+    p95 = samples[min(len(samples) - 1, int(len(samples) * 0.95))]
+    print("%-10s mean %7.2f  p50 %7.2f  p95 %7.2f ms"
+          % (name, statistics.mean(samples), statistics.median(samples), p95))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--rounds", type=int, default=20)
+    args = parser.parse_args()
+
+    get_ms, batch_ms, ws_batch_ms, ws_ping_ms = [], [], [], []
+    ws = WebSocket(args.host)
+    try:
+        for i in range(args.rounds):
+            get_ms.append(timed(lambda: [http_get(args.host, "/" + c) for c in COMMANDS]))
+            batch_ms.append(timed(lambda: http_batch(args.host, COMMANDS)))
+
+            text = json.dumps([{"cmd": c} for c in COMMANDS]).encode()
+            ws_batch_ms.append(timed(lambda: (ws.send(text, 0x1), ws.recv())))
+
+            frame = bytes([OP_PING, i & 0xFF])
+            ws_ping_ms.append(timed(lambda: (ws.send(frame, 0x2), ws.recv())))
+    finally:
+        ws.close()
+
+    print("%d rounds of %s" % (args.rounds, ", ".join(COMMANDS)))
+    summary("get", get_ms)
+    summary("batch", batch_ms)
+    summary("ws text", ws_batch_ms)
+    summary("ws ping", ws_ping_ms)
+
+
+if __name__ == "__main__":
+    main()
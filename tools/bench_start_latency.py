@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Compare playback start latency of LittleFS clips against sound bank clips.
+
+For every clip present in both stores, plays it N times from each source and
+reads the device-measured latency (command to first I2S buffer) from /status.
+
+Usage:
+    python tools/bench_start_latency.py 192.168.1.63 --runs 20
+"""
+
+import argparse
+import json
+import statistics
+import sys
+import time
+import urllib.parse
+import urllib.request
+
+
+def get(host, path, **params):
+    url = "http://%s%s" % (host, path)
+    if params:
+        url += "?" + urllib.parse.urlencode(params)
+    with urllib.request.urlopen(url, timeout=10) as resp:
+        return resp.read().decode()
+
+
+def measure(host, runs, **play_params):
+    samples = []
+    for _ in range(runs):
+        get(host, "/play", **play_params)
+        status = json.loads(get(host, "/status"))
+        samples.append(status["start_latency_us"] / 1000.0)
+        get(host, "/stop")
+        time.sleep(0.1)
+    return samples
+
+
+def summary(samples):
+    samples = sorted(samples)
+    p95 = samples[min(len(samples) - 1, int(len(samples) * 0.95))]
+    return "mean %7.2f  p50 %7.2f  p95 %7.2f ms" % (
+        statistics.mean(samples), statistics.median(samples), p95)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="node address, e.g. 192.168.1.63")
+    parser.add_argument("--runs", type=int, default=10)
+    args = parser.parse_args()
+
+    bank = {clip["name"] for clip in json.loads(get(args.host, "/bank"))}
+    files = set(json.loads(get(args.host, "/list")))
+    clips = sorted(bank & files)
+    if not clips:
+        sys.exit("no clip is present both in LittleFS and in the sound bank")
+
+    for name in clips:
+        print(name)
+        print("  littlefs  " + summary(measure(args.host, args.runs, file=name)))
+        print("  bank      " + summary(measure(args.host, args.runs, bank=name)))
+
+
+if __name__ == "__main__":
+    main()
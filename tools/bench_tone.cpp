@@ -0,0 +1,130 @@
+// Host benchmark for the tone synthesizer (src/tone_synth.cpp).
+//
+// Renders a few representative patches in player-sized blocks and reports
+// the cost per block and as a share of real time. Optionally writes each
+// patch to a WAV file for listening.
+//
+//   g++ -O2 -std=c++17 -Iinclude tools/bench_tone.cpp src/tone_synth.cpp -o bench_tone
+//   ./bench_tone [--seconds 20] [--block 256] [--wav-dir out/]
+//
+// The host is much faster than the ESP32-C3, so read the absolute numbers as
+// a relative measure. The inner loop is integer only (two table reads and
+// three multiplies per sample), so scale by cycles rather than by FLOPS.
+
+#include "tone_synth.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static constexpr uint32_t SAMPLE_RATE = 22050;
+
+struct Case {
+    const char* name;
+    TonePatch patch;
+};
+
+static TonePatch make_patch(ToneWave wave, std::initializer_list<ToneNote> notes) {
+    TonePatch p;
+    p.wave = wave;
+    for (const ToneNote& n : notes) {
+        if (p.count < TONE_MAX_NOTES) p.notes[p.count++] = n;
+    }
+    return p;
+}
+
+static void write_wav(const std::string& path, const std::vector<int16_t>& pcm) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        return;
+    }
+    uint32_t dataBytes = pcm.size() * sizeof(int16_t);
+    uint32_t riffSize = 36 + dataBytes;
+    uint32_t fmtSize = 16, rate = SAMPLE_RATE, byteRate = SAMPLE_RATE * 2;
+    uint16_t format = 1, channels = 1, align = 2, bits = 16;
+
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&riffSize, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    fwrite(&fmtSize, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);
+    fwrite(&byteRate, 4, 1, f);
+    fwrite(&align, 2, 1, f);
+    fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    fwrite(&dataBytes, 4, 1, f);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), f);
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    double seconds = 20;
+    size_t block = 256;
+    std::string wavDir;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--block") && i + 1 < argc) block = (size_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--wav-dir") && i + 1 < argc) wavDir = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--seconds N] [--block FRAMES] [--wav-dir DIR]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Case cases[] = {
+        {"chime", make_patch(ToneWave::Sine, {{1318.5f, 150, 255}, {1046.5f, 400, 220}})},
+        {"beep", make_patch(ToneWave::Square, {{880, 120, 255}, {0, 80, 0}, {880, 120, 255}})},
+        {"alarm", make_patch(ToneWave::Saw, {{440, 200, 255}, {587.3f, 200, 255},
+                                             {440, 200, 255}, {587.3f, 200, 255}})},
+        {"arpeggio", make_patch(ToneWave::Triangle, {{523.3f, 90, 255}, {659.3f, 90, 255},
+                                                     {784, 90, 255}, {1046.5f, 300, 255}})},
+    };
+
+    tone_synth_init();
+    std::vector<int16_t> buf(block);
+    double blockUs = block * 1e6 / SAMPLE_RATE;
+
+    printf("%-10s %8s %12s %12s %10s\n", "patch", "clip_ms", "ns/block", "ns/sample", "rt_pct");
+    for (Case& c : cases) {
+        ToneSynth synth;
+        synth.start(c.patch, SAMPLE_RATE);
+        uint32_t clipFrames = synth.totalFrames();
+
+        if (!wavDir.empty()) {
+            std::vector<int16_t> pcm;
+            size_t n;
+            while ((n = synth.render(buf.data(), block)) > 0) pcm.insert(pcm.end(), buf.begin(), buf.begin() + n);
+            write_wav(wavDir + "/" + c.name + ".wav", pcm);
+        }
+
+        // Render the clip repeatedly until `seconds` of audio have been made.
+        uint64_t target = (uint64_t)(seconds * SAMPLE_RATE);
+        uint64_t frames = 0, blocks = 0;
+        int64_t checksum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        while (frames < target) {
+            synth.start(c.patch, SAMPLE_RATE);
+            size_t n;
+            while ((n = synth.render(buf.data(), block)) > 0) {
+                checksum += buf[n / 2];
+                frames += n;
+                blocks++;
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        double nsPerBlock = ns / blocks;
+        printf("%-10s %8u %12.0f %12.2f %10.4f\n", c.name, clipFrames * 1000 / SAMPLE_RATE,
+               nsPerBlock, ns / frames, nsPerBlock / 1000 / blockUs * 100);
+        if (checksum == 1) printf("\n"); // keeps the loop from being optimized away
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Pack the WAV files of a directory into a sound bank image.
+
+The image is written to the raw "soundbank" partition (see partitions.csv)
+and played by the firmware straight from memory-mapped flash.
+
+Layout (little-endian):
+    header   magic "SBNK", u16 version, u16 count, u32 sample_rate, u32 image_size
+    entries  count x (char name[48], u32 offset, u32 size)
+    data     16-bit mono PCM per clip, 4-byte aligned
+
+Usage:
+    python tools/build_soundbank.py data soundbank.bin
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"SBNK"
+VERSION = 1
+SAMPLE_RATE = 22050
+NAME_LEN = 48
+HEADER = struct.Struct("<4sHHII")
+ENTRY = struct.Struct("<%dsII" % NAME_LEN)
+ALIGN = 4
+
+
+def read_pcm(path):
+    """Return the data chunk of a 16-bit mono WAV at SAMPLE_RATE."""
+    with open(path, "rb") as f:
+        blob = f.read()
+
+    if blob[0:4] != b"RIFF" or blob[8:12] != b"WAVE":
+        raise ValueError("not a RIFF/WAVE file")
+
+    fmt = None
+    pos = 12
+    while pos + 8 <= len(blob):
+        chunk_id, chunk_size = struct.unpack_from("<4sI", blob, pos)
+        body = blob[pos + 8:pos + 8 + chunk_size]
+        if chunk_id == b"fmt ":
+            fmt = struct.unpack_from("<HHIIHH", body)
+        elif chunk_id == b"data":
+            if fmt is None:
+                raise ValueError("data chunk before fmt chunk")
+            audio_format, channels, rate, _, _, bits = fmt
+            if audio_format != 1 or channels != 1 or bits != 16 or rate != SAMPLE_RATE:
+                raise ValueError(
+                    "need PCM mono 16-bit %d Hz, got format=%d channels=%d bits=%d rate=%d"
+                    % (SAMPLE_RATE, audio_format, channels, bits, rate))
+            return body[:len(body) & ~1]
+        pos += 8 + chunk_size + (chunk_size & 1)
+
+    raise ValueError("no data chunk")
+
+
+def build(src_dir):
+    names = sorted(n for n in os.listdir(src_dir) if n.lower().endswith(".wav"))
+    clips = []
+    for name in names:
+        encoded = name.encode("utf-8")
+        if len(encoded) >= NAME_LEN:
+            raise ValueError("%s: name longer than %d bytes" % (name, NAME_LEN - 1))
+        clips.append((encoded, read_pcm(os.path.join(src_dir, name))))
+
+    offset = HEADER.size + ENTRY.size * len(clips)
+    entries = []
+    data = bytearray()
+    for encoded, pcm in clips:
+        pad = -(offset + len(data)) % ALIGN
+        data += b"\0" * pad
+        entries.append(ENTRY.pack(encoded, offset + len(data), len(pcm)))
+        data += pcm
+
+    image_size = offset + len(data)
+    header = HEADER.pack(MAGIC, VERSION, len(clips), SAMPLE_RATE, image_size)
+    return header + b"".join(entries) + bytes(data), names
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("src", help="directory with .wav files")
+    parser.add_argument("out", help="output image")
+    parser.add_argument("--max-size", type=lambda v: int(v, 0), default=0x100000,
+                        help="partition size (default: 0x100000)")
+    args = parser.parse_args()
+
+    try:
+        image, names = build(args.src)
+    except (OSError, ValueError) as e:
+        sys.exit("build_soundbank: %s" % e)
+
+    if len(image) > args.max_size:
+        sys.exit("build_soundbank: image is %d bytes, partition holds %d"
+                 % (len(image), args.max_size))
+
+    with open(args.out, "wb") as f:
+        f.write(image)
+
+    print("Sound bank: %d clips, %d bytes -> %s" % (len(names), len(image), args.out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,534 @@
+#pragma once
+
+// Host stand-in for the part of ArduinoJson 7 that src/commands.cpp,
+// src/sprites.cpp and src/tones.cpp use: deserializeJson() and read-only
+// access through JsonVariantConst, JsonArrayConst and JsonObjectConst.
+// Like the real library, every node and string of a document comes from its
+// Allocator, so parsing into a JsonArena stays off the heap here as well.
+// Node sizes differ from the real library; do not size arenas from it.
+
+#include "host_shim.h"
+#include <errno.h>
+#include <limits>
+#include <type_traits>
+
+namespace ArduinoJson {
+
+class Allocator {
+public:
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr) = 0;
+    virtual void* reallocate(void* ptr, size_t new_size) = 0;
+
+protected:
+    ~Allocator() = default;
+};
+
+}  // namespace ArduinoJson
+
+namespace host_json {
+
+enum class Type : uint8_t { Null, Bool, Int, Float, String, Array, Object };
+
+struct Node {
+    const char* key;  // object members only
+    Node* next;       // next element or member
+    union {
+        bool b;
+        int64_t i;
+        double d;
+        const char* s;
+        Node* first;  // arrays and objects
+    };
+    uint32_t count;
+    Type type;
+};
+
+// Counts what documents without an allocator of their own take from the
+// heap, so a test can check that a path never does.
+inline size_t& heap_allocations() {
+    static size_t count = 0;
+    return count;
+}
+
+class MallocAllocator : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override {
+        heap_allocations()++;
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override { free(ptr); }
+    void* reallocate(void* ptr, size_t size) override {
+        heap_allocations()++;
+        return realloc(ptr, size);
+    }
+};
+
+inline ArduinoJson::Allocator* default_allocator() {
+    static MallocAllocator instance;
+    return &instance;
+}
+
+template <typename T, typename Enable = void>
+struct Conv;
+
+inline const Node* member(const Node* n, const char* key) {
+    if (!n || n->type != Type::Object) return nullptr;
+    for (const Node* c = n->first; c; c = c->next) {
+        if (strcmp(c->key, key) == 0) return c;
+    }
+    return nullptr;
+}
+
+inline const Node* element(const Node* n, size_t index) {
+    if (!n || n->type != Type::Array) return nullptr;
+    const Node* c = n->first;
+    while (c && index--) c = c->next;
+    return c;
+}
+
+}  // namespace host_json
+
+class JsonVariantConst {
+public:
+    JsonVariantConst() = default;
+    explicit JsonVariantConst(const host_json::Node* node) : _node(node) {}
+
+    template <typename T>
+    bool is() const { return host_json::Conv<T>::is(_node); }
+    template <typename T>
+    T as() const { return host_json::Conv<T>::as(_node); }
+    template <typename T>
+    operator T() const { return as<T>(); }
+    template <typename T>
+    T operator|(T fallback) const { return is<T>() ? as<T>() : fallback; }
+
+    bool isNull() const { return !_node || _node->type == host_json::Type::Null; }
+    size_t size() const {
+        using host_json::Type;
+        return _node && (_node->type == Type::Array || _node->type == Type::Object) ? _node->count : 0;
+    }
+    JsonVariantConst operator[](const char* key) const { return JsonVariantConst(host_json::member(_node, key)); }
+    JsonVariantConst operator[](size_t index) const { return JsonVariantConst(host_json::element(_node, index)); }
+    JsonVariantConst operator[](int index) const { return (*this)[(size_t)index]; }
+
+    const host_json::Node* node() const { return _node; }
+
+private:
+    const host_json::Node* _node = nullptr;
+};
+
+class JsonArrayConst {
+public:
+    class iterator {
+    public:
+        explicit iterator(const host_json::Node* node) : _node(node) {}
+        JsonVariantConst operator*() const { return JsonVariantConst(_node); }
+        iterator& operator++() {
+            _node = _node->next;
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return _node != o._node; }
+
+    private:
+        const host_json::Node* _node;
+    };
+
+    JsonArrayConst() = default;
+    explicit JsonArrayConst(const host_json::Node* node) : _node(node) {}
+
+    iterator begin() const { return iterator(_node ? _node->first : nullptr); }
+    iterator end() const { return iterator(nullptr); }
+    bool isNull() const { return !_node; }
+    size_t size() const { return _node ? _node->count : 0; }
+    JsonVariantConst operator[](size_t index) const { return JsonVariantConst(host_json::element(_node, index)); }
+    JsonVariantConst operator[](int index) const { return (*this)[(size_t)index]; }
+
+private:
+    const host_json::Node* _node = nullptr;
+};
+
+class JsonString {
+public:
+    explicit JsonString(const char* s) : _s(s) {}
+    const char* c_str() const { return _s; }
+
+private:
+    const char* _s;
+};
+
+class JsonPairConst {
+public:
+    explicit JsonPairConst(const host_json::Node* node) : _node(node) {}
+    JsonString key() const { return JsonString(_node->key); }
+    JsonVariantConst value() const { return JsonVariantConst(_node); }
+
+private:
+    const host_json::Node* _node;
+};
+
+class JsonObjectConst {
+public:
+    class iterator {
+    public:
+        explicit iterator(const host_json::Node* node) : _node(node) {}
+        JsonPairConst operator*() const { return JsonPairConst(_node); }
+        iterator& operator++() {
+            _node = _node->next;
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return _node != o._node; }
+
+    private:
+        const host_json::Node* _node;
+    };
+
+    JsonObjectConst() = default;
+    explicit JsonObjectConst(const host_json::Node* node) : _node(node) {}
+
+    iterator begin() const { return iterator(_node ? _node->first : nullptr); }
+    iterator end() const { return iterator(nullptr); }
+    bool isNull() const { return !_node; }
+    size_t size() const { return _node ? _node->count : 0; }
+    JsonVariantConst operator[](const char* key) const { return JsonVariantConst(host_json::member(_node, key)); }
+
+private:
+    const host_json::Node* _node = nullptr;
+};
+
+namespace host_json {
+
+template <typename T>
+struct Conv<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+    static bool is(const Node* n) {
+        if (!n || n->type != Type::Int) return false;
+        if (std::is_unsigned<T>::value) {
+            return n->i >= 0 && (uint64_t)n->i <= (uint64_t)std::numeric_limits<T>::max();
+        }
+        return n->i >= (int64_t)std::numeric_limits<T>::min() && n->i <= (int64_t)std::numeric_limits<T>::max();
+    }
+    static T as(const Node* n) {
+        if (n && n->type == Type::Int) return (T)n->i;
+        if (n && n->type == Type::Float) return (T)n->d;
+        return 0;
+    }
+};
+
+template <typename T>
+struct Conv<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static bool is(const Node* n) { return n && (n->type == Type::Int || n->type == Type::Float); }
+    static T as(const Node* n) {
+        if (n && n->type == Type::Int) return (T)n->i;
+        if (n && n->type == Type::Float) return (T)n->d;
+        return 0;
+    }
+};
+
+template <>
+struct Conv<bool> {
+    static bool is(const Node* n) { return n && n->type == Type::Bool; }
+    static bool as(const Node* n) { return is(n) && n->b; }
+};
+
+template <>
+struct Conv<const char*> {
+    static bool is(const Node* n) { return n && n->type == Type::String; }
+    static const char* as(const Node* n) { return is(n) ? n->s : nullptr; }
+};
+
+template <>
+struct Conv<JsonVariantConst> {
+    static bool is(const Node*) { return true; }
+    static JsonVariantConst as(const Node* n) { return JsonVariantConst(n); }
+};
+
+template <>
+struct Conv<JsonArrayConst> {
+    static bool is(const Node* n) { return n && n->type == Type::Array; }
+    static JsonArrayConst as(const Node* n) { return JsonArrayConst(is(n) ? n : nullptr); }
+};
+
+template <>
+struct Conv<JsonObjectConst> {
+    static bool is(const Node* n) { return n && n->type == Type::Object; }
+    static JsonObjectConst as(const Node* n) { return JsonObjectConst(is(n) ? n : nullptr); }
+};
+
+}  // namespace host_json
+
+class DeserializationError {
+public:
+    enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+    DeserializationError(Code code = Ok) : _code(code) {}
+    explicit operator bool() const { return _code != Ok; }
+    bool operator==(Code code) const { return _code == code; }
+    bool operator!=(Code code) const { return _code != code; }
+    Code code() const { return _code; }
+    const char* c_str() const {
+        static const char* const names[] = {"Ok", "EmptyInput", "IncompleteInput",
+                                            "InvalidInput", "NoMemory", "TooDeep"};
+        return names[_code];
+    }
+
+private:
+    Code _code;
+};
+
+namespace DeserializationOption {
+
+struct NestingLimit {
+    explicit NestingLimit(uint8_t n = 10) : value(n) {}
+    uint8_t value;
+};
+
+}  // namespace DeserializationOption
+
+class JsonDocument {
+public:
+    explicit JsonDocument(ArduinoJson::Allocator* alloc = host_json::default_allocator()) : _alloc(alloc) {}
+    ~JsonDocument() { clear(); }
+    JsonDocument(const JsonDocument&) = delete;
+    JsonDocument& operator=(const JsonDocument&) = delete;
+
+    void clear() {
+        while (_blocks) {
+            Block* next = _blocks->next;
+            _alloc->deallocate(_blocks);
+            _blocks = next;
+        }
+        _root = nullptr;
+    }
+
+    template <typename T>
+    bool is() const { return host_json::Conv<T>::is(_root); }
+    template <typename T>
+    T as() const { return host_json::Conv<T>::as(_root); }
+    JsonVariantConst operator[](const char* key) const { return JsonVariantConst(host_json::member(_root, key)); }
+
+    // Parser interface.
+    void* alloc(size_t size) {
+        Block* b = (Block*)_alloc->allocate(sizeof(Block) + size);
+        if (!b) return nullptr;
+        b->next = _blocks;
+        _blocks = b;
+        return b + 1;
+    }
+    host_json::Node* newNode() {
+        host_json::Node* n = (host_json::Node*)alloc(sizeof(host_json::Node));
+        if (n) memset(n, 0, sizeof(*n));
+        return n;
+    }
+    void setRoot(host_json::Node* root) { _root = root; }
+
+private:
+    struct alignas(8) Block {
+        Block* next;
+    };
+
+    ArduinoJson::Allocator* _alloc;
+    Block* _blocks = nullptr;
+    host_json::Node* _root = nullptr;
+};
+
+namespace host_json {
+
+class Parser {
+public:
+    Parser(JsonDocument& doc, const char* p, size_t len, uint8_t nesting)
+        : _doc(doc), _p(p), _end(p + len), _nesting(nesting) {}
+
+    DeserializationError run() {
+        skipSpace();
+        if (_p == _end) return DeserializationError::EmptyInput;
+        Node* root = _doc.newNode();
+        if (!root) return DeserializationError::NoMemory;
+        DeserializationError::Code err = value(root, _nesting);
+        if (err != DeserializationError::Ok) return err;
+        _doc.setRoot(root);
+        return DeserializationError::Ok;
+    }
+
+private:
+    using Code = DeserializationError::Code;
+
+    void skipSpace() {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r')) _p++;
+    }
+
+    Code value(Node* out, uint8_t nesting) {
+        skipSpace();
+        if (_p == _end) return DeserializationError::IncompleteInput;
+        char c = *_p;
+        if (c == '{' || c == '[') return container(out, nesting, c == '{');
+        if (c == '"') {
+            out->type = Type::String;
+            return string(&out->s);
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) return number(out);
+        if (literal("true")) {
+            out->type = Type::Bool;
+            out->b = true;
+            return DeserializationError::Ok;
+        }
+        if (literal("false")) {
+            out->type = Type::Bool;
+            return DeserializationError::Ok;
+        }
+        if (literal("null")) return DeserializationError::Ok;
+        return (size_t)(_end - _p) < 5 ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(_end - _p) < n || memcmp(_p, word, n) != 0) return false;
+        _p += n;
+        return true;
+    }
+
+    Code container(Node* out, uint8_t nesting, bool object) {
+        if (nesting == 0) return DeserializationError::TooDeep;
+        char close = object ? '}' : ']';
+        out->type = object ? Type::Object : Type::Array;
+        _p++;
+        skipSpace();
+        if (_p < _end && *_p == close) {
+            _p++;
+            return DeserializationError::Ok;
+        }
+
+        Node** tail = &out->first;
+        for (;;) {
+            Node* child = _doc.newNode();
+            if (!child) return DeserializationError::NoMemory;
+            *tail = child;
+            tail = &child->next;
+            out->count++;
+
+            skipSpace();
+            if (object) {
+                if (_p == _end) return DeserializationError::IncompleteInput;
+                if (*_p != '"') return DeserializationError::InvalidInput;
+                Code err = string(&child->key);
+                if (err != DeserializationError::Ok) return err;
+                skipSpace();
+                if (_p == _end) return DeserializationError::IncompleteInput;
+                if (*_p++ != ':') return DeserializationError::InvalidInput;
+            }
+            Code err = value(child, nesting - 1);
+            if (err != DeserializationError::Ok) return err;
+
+            skipSpace();
+            if (_p == _end) return DeserializationError::IncompleteInput;
+            char c = *_p++;
+            if (c == close) return DeserializationError::Ok;
+            if (c != ',') return DeserializationError::InvalidInput;
+        }
+    }
+
+    Code string(const char** out) {
+        const char* start = ++_p;
+        const char* q = start;
+        while (q < _end && *q != '"') q += *q == '\\' ? 2 : 1;
+        if (q >= _end) return DeserializationError::IncompleteInput;
+
+        // The escaped form is never shorter than the decoded one.
+        char* s = (char*)_doc.alloc(q - start + 1);
+        if (!s) return DeserializationError::NoMemory;
+        char* w = s;
+        while (_p < q) {
+            char c = *_p++;
+            if (c != '\\') {
+                *w++ = c;
+                continue;
+            }
+            c = *_p++;
+            switch (c) {
+                case 'b': *w++ = '\b'; break;
+                case 'f': *w++ = '\f'; break;
+                case 'n': *w++ = '\n'; break;
+                case 'r': *w++ = '\r'; break;
+                case 't': *w++ = '\t'; break;
+                case 'u': {
+                    if (q - _p < 4) return DeserializationError::InvalidInput;
+                    char hex[5] = {_p[0], _p[1], _p[2], _p[3], 0};
+                    char* endp;
+                    unsigned long cp = strtoul(hex, &endp, 16);
+                    if (*endp) return DeserializationError::InvalidInput;
+                    _p += 4;
+                    if (cp < 0x80) {
+                        *w++ = (char)cp;
+                    } else if (cp < 0x800) {
+                        *w++ = (char)(0xC0 | (cp >> 6));
+                        *w++ = (char)(0x80 | (cp & 0x3F));
+                    } else {
+                        *w++ = (char)(0xE0 | (cp >> 12));
+                        *w++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                        *w++ = (char)(0x80 | (cp & 0x3F));
+                    }
+                    break;
+                }
+                default: *w++ = c; break;  // \" \\ \/
+            }
+        }
+        *w = '\0';
+        _p = q + 1;
+        *out = s;
+        return DeserializationError::Ok;
+    }
+
+    Code number(Node* out) {
+        char buf[40];
+        size_t n = 0;
+        bool integer = true;
+        while (_p < _end && n < sizeof(buf) - 1 && strchr("+-0123456789.eE", *_p)) {
+            if (*_p == '.' || *_p == 'e' || *_p == 'E') integer = false;
+            buf[n++] = *_p++;
+        }
+        buf[n] = '\0';
+
+        char* endp;
+        if (integer) {
+            errno = 0;
+            long long v = strtoll(buf, &endp, 10);
+            if (*endp == '\0' && errno == 0) {
+                out->type = Type::Int;
+                out->i = v;
+                return DeserializationError::Ok;
+            }
+        }
+        double d = strtod(buf, &endp);
+        if (*endp != '\0') return DeserializationError::InvalidInput;
+        out->type = Type::Float;
+        out->d = d;
+        return DeserializationError::Ok;
+    }
+
+    JsonDocument& _doc;
+    const char* _p;
+    const char* _end;
+    uint8_t _nesting;
+};
+
+}  // namespace host_json
+
+inline DeserializationError deserializeJson(
+    JsonDocument& doc, const char* json, size_t len,
+    DeserializationOption::NestingLimit limit = DeserializationOption::NestingLimit()) {
+    doc.clear();
+    return host_json::Parser(doc, json, len, limit.value).run();
+}
+
+inline DeserializationError deserializeJson(JsonDocument& doc, const char* json) {
+    return deserializeJson(doc, json, strlen(json));
+}
+
+// The file is read into the document's own memory first.
+inline DeserializationError deserializeJson(JsonDocument& doc, File& file) {
+    doc.clear();
+    size_t size = file.size();
+    char* text = (char*)doc.alloc(size ? size : 1);
+    if (!text) return DeserializationError::NoMemory;
+    if (file.read((uint8_t*)text, size) != size) return DeserializationError::IncompleteInput;
+    return host_json::Parser(doc, text, size, DeserializationOption::NestingLimit().value).run();
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "host_shim.h"
+
+// control.h declares control_init() against the server; the host tools call
+// src/commands.cpp directly and never serve HTTP.
+class AsyncWebServer;
@@ -0,0 +1,517 @@
+// Host implementation of host_shim.h. See the header for the model.
+
+#include "host_shim.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+// -----------------------------------------------------------------------------
+// Virtual clock
+// -----------------------------------------------------------------------------
+
+using RealClock = std::chrono::steady_clock;
+
+static std::mutex clockLock;
+static double clockSpeed = 1.0;
+static RealClock::time_point realAnchor = RealClock::now();
+static int64_t virtAnchorUs = 0;
+
+static int64_t real_elapsed_us(RealClock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(RealClock::now() - since).count();
+}
+
+void host::set_speed(double speed) {
+    std::lock_guard<std::mutex> g(clockLock);
+    virtAnchorUs += (int64_t)(real_elapsed_us(realAnchor) * clockSpeed);
+    realAnchor = RealClock::now();
+    clockSpeed = speed > 0 ? speed : 1.0;
+}
+
+double host::speed() {
+    std::lock_guard<std::mutex> g(clockLock);
+    return clockSpeed;
+}
+
+int64_t host::now_us() {
+    std::lock_guard<std::mutex> g(clockLock);
+    return virtAnchorUs + (int64_t)(real_elapsed_us(realAnchor) * clockSpeed);
+}
+
+// Virtual microseconds to a real duration.
+static std::chrono::microseconds real_duration(int64_t virtUs) {
+    return std::chrono::microseconds((int64_t)(max<int64_t>(virtUs, 0) / host::speed()));
+}
+
+static std::chrono::microseconds ticks_to_real(TickType_t ticks) {
+    return real_duration((int64_t)ticks * 1000);
+}
+
+// Waits on `cv` until `ready()` or `ticks` pass; portMAX_DELAY waits forever.
+template <typename Pred>
+static bool wait_ticks(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Pred ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, ticks_to_real(ticks), ready);
+}
+
+// -----------------------------------------------------------------------------
+// Arduino
+// -----------------------------------------------------------------------------
+
+HostSerial Serial;
+static std::atomic<bool> quiet{false};
+
+void host::set_quiet(bool q) { quiet = q; }
+
+void HostSerial::printf(const char* fmt, ...) {
+    if (quiet) return;
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void HostSerial::println(const char* s) {
+    if (!quiet) ::printf("%s\n", s);
+}
+
+void HostSerial::print(const char* s) {
+    if (!quiet) ::printf("%s", s);
+}
+
+unsigned long millis() { return (unsigned long)(host::now_us() / 1000); }
+unsigned long micros() { return (unsigned long)host::now_us(); }
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+long random(long howbig) {
+    static std::mutex lock;
+    static std::mt19937 gen(1);
+    std::lock_guard<std::mutex> g(lock);
+    return howbig > 0 ? (long)(gen() % (unsigned long)howbig) : 0;
+}
+
+#ifdef HOST_NEEDS_STRLCPY
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = min(len, size - 1);
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// FreeRTOS
+// -----------------------------------------------------------------------------
+
+struct HostQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;
+    size_t itemSize;
+    size_t length;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t*, StaticQueue_t*) {
+    HostQueue* q = new HostQueue;
+    q->storage.resize(length * itemSize);
+    q->itemSize = itemSize;
+    q->length = length;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!wait_ticks(q->changed, lock, wait, [&] { return q->count < q->length; })) return pdFALSE;
+    size_t tail = (q->head + q->count) % q->length;
+    memcpy(&q->storage[tail * q->itemSize], item, q->itemSize);
+    q->count++;
+    q->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!wait_ticks(q->changed, lock, wait, [&] { return q->count > 0; })) return pdFALSE;
+    memcpy(item, &q->storage[q->head * q->itemSize], q->itemSize);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    q->changed.notify_all();
+    return pdTRUE;
+}
+
+struct HostEventGroup {
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t*) {
+    return new HostEventGroup;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(g->lock);
+    g->bits |= bits;
+    g->changed.notify_all();
+    return g->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(g->lock);
+    EventBits_t before = g->bits;
+    g->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g) {
+    std::lock_guard<std::mutex> lock(g->lock);
+    return g->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clearOnExit,
+                                BaseType_t waitForAll, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(g->lock);
+    auto ready = [&] { return waitForAll ? (g->bits & bits) == bits : (g->bits & bits) != 0; };
+    bool ok = wait_ticks(g->changed, lock, wait, ready);
+    EventBits_t result = g->bits;
+    if (ok && clearOnExit) g->bits &= ~bits;
+    return result;
+}
+
+struct HostMutex {
+    std::mutex lock;
+    std::condition_variable released;
+    bool taken = false;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t*) {
+    return new HostMutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(s->lock);
+    if (!wait_ticks(s->released, lock, wait, [&] { return !s->taken; })) return pdFALSE;
+    s->taken = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    std::lock_guard<std::mutex> lock(s->lock);
+    if (!s->taken) return pdFALSE;
+    s->taken = false;
+    s->released.notify_one();
+    return pdTRUE;
+}
+
+struct HostTask {};
+
+// Tasks never return in the firmware; the threads are detached and end with
+// the process.
+TaskHandle_t xTaskCreateStatic(TaskFunction_t entry, const char*, uint32_t, void* arg,
+                               UBaseType_t, StackType_t*, StaticTask_t*) {
+    std::thread(entry, arg).detach();
+    return new HostTask;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) std::this_thread::yield();
+    else std::this_thread::sleep_for(ticks_to_real(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(host::now_us() / 1000);
+}
+
+// -----------------------------------------------------------------------------
+// esp_timer, heap_caps, GPIO
+// -----------------------------------------------------------------------------
+
+int64_t esp_timer_get_time() { return host::now_us(); }
+
+// A pretend 200 KB heap, so /mem-style numbers stay meaningful.
+static constexpr size_t HEAP_SIZE = 200 * 1024;
+static std::atomic<size_t> heapCapsUsed{0};
+static std::atomic<size_t> heapCapsPeak{0};
+
+void* heap_caps_malloc(size_t size, uint32_t) {
+    if (heapCapsUsed + size > HEAP_SIZE) return nullptr;
+    heapCapsUsed += size;
+    heapCapsPeak = max<size_t>(heapCapsPeak, heapCapsUsed);
+    return malloc(size);
+}
+
+size_t heap_caps_get_free_size(uint32_t) { return HEAP_SIZE - heapCapsUsed; }
+size_t heap_caps_get_minimum_free_size(uint32_t) { return HEAP_SIZE - heapCapsPeak; }
+size_t heap_caps_get_largest_free_block(uint32_t) { return HEAP_SIZE - heapCapsUsed; }
+
+static std::atomic<int> gpioLevels[64];
+
+void pinMode(uint8_t, uint8_t) {}
+esp_err_t gpio_hold_dis(gpio_num_t) { return ESP_OK; }
+esp_err_t gpio_set_direction(gpio_num_t, gpio_mode_t) { return ESP_OK; }
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+    if (pin < 0 || pin >= 64) return ESP_FAIL;
+    gpioLevels[pin] = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int host::gpio_level(int pin) {
+    return pin >= 0 && pin < 64 ? gpioLevels[pin].load() : -1;
+}
+
+// -----------------------------------------------------------------------------
+// I2S: a DMA queue of dma_buf_count * dma_buf_len frames drained at the
+// sample rate while started
+// -----------------------------------------------------------------------------
+
+static struct {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool installed = false;
+    bool running = false;
+    uint32_t rate = 0;
+    size_t capacity = 0;       // frames
+    size_t bufLen = 0;
+    double queued = 0;         // frames not yet played
+    int64_t drainedAt = 0;
+    host::I2sStats stats{};
+} i2s;
+
+static std::atomic<uint32_t> i2sStallMs{0};
+
+void host::set_i2s_stall_ms(uint32_t ms) { i2sStallMs = ms; }
+
+host::I2sStats host::i2s_stats() {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    host::I2sStats s = i2s.stats;
+    s.installed = i2s.installed;
+    s.running = i2s.running;
+    return s;
+}
+
+// Caller holds i2s.lock.
+static void i2s_drain() {
+    int64_t now = host::now_us();
+    if (i2s.running) {
+        i2s.queued = max(0.0, i2s.queued - (now - i2s.drainedAt) * (double)i2s.rate / 1e6);
+    }
+    i2s.drainedAt = now;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t, const i2s_config_t* cfg, int, void*) {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    if (i2s.installed) return ESP_ERR_INVALID_STATE;
+    i2s.installed = true;
+    i2s.running = true; // the legacy driver starts TX on install
+    i2s.rate = cfg->sample_rate;
+    i2s.bufLen = cfg->dma_buf_len;
+    i2s.capacity = (size_t)cfg->dma_buf_count * cfg->dma_buf_len;
+    i2s.queued = 0;
+    i2s.drainedAt = host::now_us();
+    i2s.stats.installs++;
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t) {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    if (!i2s.installed) return ESP_ERR_INVALID_STATE;
+    i2s.installed = false;
+    i2s.running = false;
+    i2s.queued = 0;
+    i2s.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t, const i2s_pin_config_t*) { return ESP_OK; }
+
+esp_err_t i2s_start(i2s_port_t) {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    if (!i2s.installed) return ESP_ERR_INVALID_STATE;
+    i2s_drain();
+    i2s.running = true;
+    i2s.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t i2s_stop(i2s_port_t) {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    if (!i2s.installed) return ESP_ERR_INVALID_STATE;
+    i2s_drain();
+    i2s.running = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t) {
+    std::lock_guard<std::mutex> g(i2s.lock);
+    if (!i2s.installed) return ESP_ERR_INVALID_STATE;
+    i2s.queued = 0;
+    i2s.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t i2s_write(i2s_port_t, const void* src, size_t size, size_t* written, TickType_t wait) {
+    *written = 0;
+    uint32_t stall = i2sStallMs;
+    if (stall) std::this_thread::sleep_for(std::chrono::milliseconds(stall));
+
+    std::unique_lock<std::mutex> lock(i2s.lock);
+    if (!i2s.installed) {
+        i2s.stats.write_errors++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const int16_t* samples = (const int16_t*)src;
+    size_t frames = size / sizeof(int16_t);
+    size_t done = 0;
+    int64_t deadline = wait == portMAX_DELAY ? INT64_MAX : host::now_us() + (int64_t)wait * 1000;
+
+    for (;;) {
+        i2s_drain();
+        size_t space = i2s.capacity - min(i2s.capacity, (size_t)ceil(i2s.queued));
+        size_t n = min(space, frames - done);
+        for (size_t i = 0; i < n; i++) {
+            if (samples[done + i] == host::POISON_SAMPLE) i2s.stats.poison_hits++;
+        }
+        i2s.queued += n;
+        i2s.stats.frames_written += n;
+        done += n;
+        if (done == frames) break;
+
+        int64_t now = host::now_us();
+        if (now >= deadline || !i2s.installed) break;
+
+        // Sleep until a DMA buffer's worth has played, or the deadline.
+        int64_t untilUs = deadline - now;
+        if (i2s.running) {
+            size_t need = min(frames - done, i2s.bufLen);
+            untilUs = min<int64_t>(untilUs, (int64_t)(need * 1e6 / i2s.rate) + 1);
+        }
+        i2s.changed.wait_for(lock, real_duration(untilUs));
+    }
+
+    *written = done * sizeof(int16_t);
+    return ESP_OK;
+}
+
+// -----------------------------------------------------------------------------
+// LittleFS
+// -----------------------------------------------------------------------------
+
+HostFS LittleFS;
+static std::string fsRoot = ".";
+static std::atomic<int> openFiles{0};
+
+void host::set_fs_root(const char* dir) { fsRoot = dir; }
+int host::open_files() { return openFiles; }
+
+static std::string host_path(const char* path) {
+    return fsRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+struct HostFile {
+    FILE* file = nullptr;
+    DIR* dir = nullptr;
+    std::string path;   // as seen by the firmware
+    std::string name;   // last component, like fs::File::name()
+
+    HostFile(FILE* f, DIR* d, const char* p) : file(f), dir(d), path(p) {
+        const char* slash = strrchr(p, '/');
+        name = slash ? slash + 1 : p;
+        openFiles++;
+    }
+    ~HostFile() { close(); }
+
+    void close() {
+        if (!file && !dir) return;
+        if (file) fclose(file);
+        if (dir) closedir(dir);
+        file = nullptr;
+        dir = nullptr;
+        openFiles--;
+    }
+};
+
+File::operator bool() const { return _impl && (_impl->file || _impl->dir); }
+
+size_t File::size() {
+    if (!_impl || !_impl->file) return 0;
+    struct stat st;
+    fflush(_impl->file);
+    return fstat(fileno(_impl->file), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+size_t File::position() {
+    return _impl && _impl->file ? (size_t)ftell(_impl->file) : 0;
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+    return _impl && _impl->file ? fread(buf, 1, len, _impl->file) : 0;
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+    return _impl && _impl->file ? fwrite(buf, 1, len, _impl->file) : 0;
+}
+
+bool File::seek(size_t pos) {
+    return _impl && _impl->file && fseek(_impl->file, (long)pos, SEEK_SET) == 0;
+}
+
+void File::close() {
+    if (_impl) _impl->close();
+    _impl.reset();
+}
+
+bool File::isDirectory() { return _impl && _impl->dir; }
+
+File File::openNextFile() {
+    if (!_impl || !_impl->dir) return File();
+    while (struct dirent* e = readdir(_impl->dir)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        std::string child = _impl->path + (_impl->path == "/" ? "" : "/") + e->d_name;
+        return LittleFS.open(child.c_str(), "r");
+    }
+    return File();
+}
+
+const char* File::name() { return _impl ? _impl->name.c_str() : ""; }
+
+File HostFS::open(const char* path, const char* mode) {
+    std::string full = host_path(path);
+    struct stat st;
+    if (mode[0] == 'r' && stat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* d = opendir(full.c_str());
+        return d ? File(std::make_shared<HostFile>(nullptr, d, path)) : File();
+    }
+    const char* fmode = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "rb";
+    FILE* f = fopen(full.c_str(), fmode);
+    return f ? File(std::make_shared<HostFile>(f, nullptr, path)) : File();
+}
+
+bool HostFS::exists(const char* path) {
+    struct stat st;
+    return stat(host_path(path).c_str(), &st) == 0;
+}
+
+bool HostFS::remove(const char* path) { return ::remove(host_path(path).c_str()) == 0; }
+
+bool HostFS::rename(const char* from, const char* to) {
+    return ::rename(host_path(from).c_str(), host_path(to).c_str()) == 0;
+}
+
+size_t HostFS::totalBytes() { return 1408 * 1024; }
+size_t HostFS::usedBytes() { return 0; }
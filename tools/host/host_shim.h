@@ -0,0 +1,263 @@
+#pragma once
+
+// Host build of the small part of Arduino-ESP32 / ESP-IDF that the player
+// task and the memory pool use: FreeRTOS queues, event groups, mutexes and
+// tasks, the legacy I2S driver, GPIO, esp_timer, heap_caps and LittleFS.
+// It is enough to run src/audio_player.cpp and src/mem_pool.cpp unchanged on
+// a PC (tools/stress_player.cpp, tools/soak_mem.cpp). With ArduinoJson.h
+// beside it, src/commands.cpp, src/sprites.cpp and src/tones.cpp build too;
+// nothing else in the firmware is meant to build against it.
+//
+// Tasks are threads. Time is a virtual clock that runs host::speed() times
+// faster than real time: ticks are its milliseconds, and the I2S DMA queue
+// drains at the sample rate of that clock, so a clip plays in 1/speed of its
+// length and every timeout scales with it.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using std::max;
+using std::min;
+
+// -----------------------------------------------------------------------------
+// Test controls and observations
+// -----------------------------------------------------------------------------
+
+namespace host {
+
+void set_speed(double speed);
+double speed();
+int64_t now_us();                  // virtual clock
+
+void set_quiet(bool quiet);        // drop Serial output
+void set_fs_root(const char* dir); // LittleFS "/" maps here
+
+// Makes every i2s_write() sleep this long first (real time), which stalls the
+// player task the way a wedged driver or flash access would.
+void set_i2s_stall_ms(uint32_t ms);
+
+// Samples equal to this value count in i2s_poison_hits(). Tests fill buffers
+// they have handed back with it to catch reads after release.
+constexpr int16_t POISON_SAMPLE = 0x5A5A;
+
+struct I2sStats {
+    bool installed;
+    bool running;
+    uint32_t installs;
+    uint64_t frames_written;
+    uint32_t write_errors;     // writes while not installed
+    uint32_t poison_hits;
+};
+I2sStats i2s_stats();
+
+int gpio_level(int pin);
+int open_files();
+
+}  // namespace host
+
+// -----------------------------------------------------------------------------
+// Arduino
+// -----------------------------------------------------------------------------
+
+#define OUTPUT 0x03
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+long random(long howbig);
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#define HOST_NEEDS_STRLCPY 1
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+class HostSerial {
+public:
+    void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    void println(const char* s);
+    void print(const char* s);
+};
+extern HostSerial Serial;
+
+class IPAddress {
+public:
+    IPAddress() = default;
+    bool operator==(const IPAddress& o) const { return _addr == o._addr; }
+private:
+    uint32_t _addr = 0;
+};
+
+// -----------------------------------------------------------------------------
+// FreeRTOS
+// -----------------------------------------------------------------------------
+
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define BIT0 (1u << 0)
+#define BIT1 (1u << 1)
+#define BIT2 (1u << 2)
+#define BIT3 (1u << 3)
+#define BIT4 (1u << 4)
+#define BIT5 (1u << 5)
+
+struct HostQueue;
+struct HostEventGroup;
+struct HostMutex;
+struct HostTask;
+typedef HostQueue* QueueHandle_t;
+typedef HostEventGroup* EventGroupHandle_t;
+typedef HostMutex* SemaphoreHandle_t;
+typedef HostTask* TaskHandle_t;
+
+// Static storage is ignored; the objects live on the host heap, created once.
+struct StaticQueue_t { void* unused; };
+struct StaticEventGroup_t { void* unused; };
+struct StaticSemaphore_t { void* unused; };
+struct StaticTask_t { void* unused; };
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t* storage, StaticQueue_t* buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* buffer);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit,
+                                BaseType_t waitForAll, TickType_t wait);
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* arg,
+                               UBaseType_t priority, StackType_t* stack, StaticTask_t* buffer);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+// Spinlocks nest on the same core, hence the recursive mutex.
+struct portMUX_TYPE {
+    std::recursive_mutex m;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->m.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->m.unlock())
+
+// -----------------------------------------------------------------------------
+// ESP-IDF
+// -----------------------------------------------------------------------------
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+
+int64_t esp_timer_get_time();
+
+#define MALLOC_CAP_DMA  (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+void* heap_caps_malloc(size_t size, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_OUTPUT = 2 } gpio_mode_t;
+esp_err_t gpio_hold_dis(gpio_num_t pin);
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+typedef enum { I2S_NUM_0 = 0 } i2s_port_t;
+typedef enum { I2S_MODE_MASTER = 1, I2S_MODE_TX = 4 } i2s_mode_t;
+typedef enum { I2S_BITS_PER_SAMPLE_16BIT = 16 } i2s_bits_per_sample_t;
+typedef enum { I2S_CHANNEL_FMT_ONLY_LEFT = 4 } i2s_channel_fmt_t;
+typedef enum { I2S_COMM_FORMAT_I2S_MSB = 3 } i2s_comm_format_t;
+#define I2S_PIN_NO_CHANGE (-1)
+
+typedef struct {
+    i2s_mode_t mode;
+    uint32_t sample_rate;
+    i2s_bits_per_sample_t bits_per_sample;
+    i2s_channel_fmt_t channel_format;
+    i2s_comm_format_t communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+    bool use_apll;
+    bool tx_desc_auto_clear;
+} i2s_config_t;
+
+typedef struct {
+    int bck_io_num;
+    int ws_io_num;
+    int data_out_num;
+    int data_in_num;
+} i2s_pin_config_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queueSize, void* queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t port);
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t* pins);
+esp_err_t i2s_start(i2s_port_t port);
+esp_err_t i2s_stop(i2s_port_t port);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port);
+esp_err_t i2s_write(i2s_port_t port, const void* src, size_t size, size_t* written, TickType_t wait);
+
+// -----------------------------------------------------------------------------
+// LittleFS, backed by a host directory
+// -----------------------------------------------------------------------------
+
+struct HostFile;
+
+class File {
+public:
+    File() = default;
+    explicit File(std::shared_ptr<HostFile> impl) : _impl(std::move(impl)) {}
+    explicit operator bool() const;
+    size_t size();
+    size_t position();
+    size_t read(uint8_t* buf, size_t len);
+    size_t write(const uint8_t* buf, size_t len);
+    bool seek(size_t pos);
+    void close();
+    bool isDirectory();
+    File openNextFile();
+    const char* name();
+private:
+    std::shared_ptr<HostFile> _impl;
+};
+
+class HostFS {
+public:
+    File open(const char* path, const char* mode = "r");
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    size_t totalBytes();
+    size_t usedBytes();
+};
+extern HostFS LittleFS;
@@ -0,0 +1,361 @@
+#!/usr/bin/env python3
+"""Load generator and soak test for the node's HTTP API.
+
+Replays the traffic a backend such as BirdIdentifier produces: bursts of
+/play, overlapping /stream uploads, /stop in the middle of an upload and
+/list polling. Requests arrive as a Poisson process at --rate per second,
+split by --mix weights, with at most --concurrency in flight. A sampler
+polls /status for heap, fragmentation and audio underruns over time.
+
+The report is JSON with sorted keys and rounded values. Keep one per
+firmware version and compare them with --compare.
+
+Usage:
+    python tools/loadgen.py --host 192.168.1.63 --duration 600 --rate 2 \\
+        --mix play=5,list=2,status=2,stream=1,stream_stop=1,stop=1 --report v1.json
+    python tools/loadgen.py --compare v1.json v2.json
+"""
+
+import argparse
+import http.client
+import json
+import random
+import socket
+import statistics
+import threading
+import time
+import urllib.parse
+import wave
+from concurrent.futures import ThreadPoolExecutor
+
+SAMPLE_RATE = 22050
+DEFAULT_MIX = "play=5,play_random=1,stop=1,list=2,status=2,stream=1,stream_stop=1,batch=1"
+TIMEOUT_S = 15
+
+
+# -----------------------------------------------------------------------------
+# HTTP helpers
+# -----------------------------------------------------------------------------
+
+def request(host, port, method, path, body=None, chunk=1024, timeout=TIMEOUT_S):
+    """Returns (status, body bytes). Bodies are sent in chunks like an upload."""
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.putrequest(method, path)
+        if body is not None:
+            conn.putheader("Content-Type", "application/octet-stream")
+            conn.putheader("Content-Length", str(len(body)))
+        conn.endheaders()
+        if body is not None:
+            for pos in range(0, len(body), chunk):
+                conn.send(body[pos:pos + chunk])
+        resp = conn.getresponse()
+        return resp.status, resp.read()
+    finally:
+        conn.close()
+
+
+def error_class(exc):
+    if isinstance(exc, socket.timeout):
+        return "timeout"
+    if isinstance(exc, ConnectionRefusedError):
+        return "refused"
+    if isinstance(exc, (ConnectionResetError, BrokenPipeError)):
+        return "reset"
+    return type(exc).__name__
+
+
+# -----------------------------------------------------------------------------
+# Scenarios
+# -----------------------------------------------------------------------------
+
+class Target:
+    def __init__(self, host, port, wav_body, files):
+        self.host = host
+        self.port = port
+        self.wav_body = wav_body
+        self.files = files
+
+    def get(self, path):
+        return request(self.host, self.port, "GET", path)
+
+    def play(self, rng):
+        return self.get("/play?" + urllib.parse.urlencode({"file": rng.choice(self.files)}))
+
+    def play_random(self, rng):
+        return self.get("/play_random")
+
+    def stop(self, rng):
+        return self.get("/stop")
+
+    def list(self, rng):
+        return self.get("/list")
+
+    def status(self, rng):
+        return self.get("/status")
+
+    def batch(self, rng):
+        body = json.dumps([{"cmd": "stop"}, {"cmd": "play", "file": rng.choice(self.files)},
+                           {"cmd": "status"}]).encode()
+        return request(self.host, self.port, "POST", "/batch", body)
+
+    def stream(self, rng):
+        return request(self.host, self.port, "POST", "/stream", self.wav_body)
+
+    def stream_stop(self, rng):
+        """Upload a stream and hit /stop part-way through it."""
+        duration = max(0.0, (len(self.wav_body) - 44) / 2 / SAMPLE_RATE)
+        stopper = threading.Timer(rng.uniform(0.1, max(0.2, duration / 2)), self.get, ("/stop",))
+        stopper.start()
+        try:
+            return self.stream(rng)
+        finally:
+            stopper.join()
+
+
+def parse_mix(text):
+    mix = {}
+    for item in text.split(","):
+        name, _, weight = item.partition("=")
+        if not hasattr(Target, name) or name.startswith("_") or name in ("get",):
+            raise SystemExit("unknown scenario in --mix: %s" % name)
+        mix[name] = float(weight or 1)
+    return mix
+
+
+# -----------------------------------------------------------------------------
+# Runner
+# -----------------------------------------------------------------------------
+
+class Recorder:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.results = []   # (scenario, start_s, latency_ms, outcome)
+        self.samples = []   # /status snapshots
+
+    def add(self, scenario, start, latency_ms, outcome):
+        with self.lock:
+            self.results.append((scenario, start, latency_ms, outcome))
+
+
+def run_one(target, scenario, seed, rec, t0):
+    rng = random.Random(seed)
+    start = time.perf_counter()
+    try:
+        status, _ = getattr(target, scenario)(rng)
+        outcome = str(status)
+    except Exception as exc:  # every failure is a data point
+        outcome = error_class(exc)
+    rec.add(scenario, start - t0, (time.perf_counter() - start) * 1000, outcome)
+
+
+def sample_status(target, rec, t0, interval, stop):
+    while not stop.wait(interval):
+        try:
+            status, body = target.get("/status")
+            if status == 200:
+                snap = json.loads(body)
+                snap["t"] = round(time.perf_counter() - t0, 1)
+                with rec.lock:
+                    rec.samples.append(snap)
+        except Exception:
+            pass
+
+
+def run(args, target):
+    mix = parse_mix(args.mix)
+    names = list(mix)
+    weights = [mix[n] for n in names]
+    rng = random.Random(args.seed)
+    rec = Recorder()
+
+    stop = threading.Event()
+    t0 = time.perf_counter()
+    sampler = threading.Thread(target=sample_status,
+                               args=(target, rec, t0, args.sample_interval, stop), daemon=True)
+    sampler.start()
+
+    with ThreadPoolExecutor(max_workers=args.concurrency) as pool:
+        pending = []
+        next_at = t0
+        while True:
+            next_at += rng.expovariate(args.rate)
+            if next_at - t0 >= args.duration:
+                break
+            time.sleep(max(0.0, next_at - time.perf_counter()))
+            pending = [f for f in pending if not f.done()]
+            if len(pending) >= args.concurrency:
+                rec.add("_dropped", next_at - t0, 0.0, "client_busy")
+                continue
+            scenario = rng.choices(names, weights)[0]
+            pending.append(pool.submit(run_one, target, scenario, rng.getrandbits(32), rec, t0))
+    stop.set()
+    sampler.join()
+    return rec
+
+
+# -----------------------------------------------------------------------------
+# Report
+# -----------------------------------------------------------------------------
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    k = (len(sorted_values) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(sorted_values) - 1)
+    return sorted_values[lo] + (sorted_values[hi] - sorted_values[lo]) * (k - lo)
+
+
+def summarize(rec, args):
+    scenarios = {}
+    for name in sorted({r[0] for r in rec.results}):
+        rows = [r for r in rec.results if r[0] == name]
+        lat = sorted(r[2] for r in rows)
+        outcomes = {}
+        for r in rows:
+            outcomes[r[3]] = outcomes.get(r[3], 0) + 1
+        ok = sum(n for code, n in outcomes.items() if code.startswith("2"))
+        scenarios[name] = {
+            "count": len(rows),
+            "ok": ok,
+            "error_rate": round(1 - ok / len(rows), 4),
+            "outcomes": outcomes,
+            "latency_ms": {
+                "p50": round(percentile(lat, 50), 1),
+                "p90": round(percentile(lat, 90), 1),
+                "p99": round(percentile(lat, 99), 1),
+                "max": round(lat[-1], 1),
+                "mean": round(statistics.mean(lat), 1),
+            },
+        }
+
+    samples = rec.samples
+    device = {}
+    if samples:
+        def series(key):
+            return [s[key] for s in samples if key in s]
+        heap = series("heap_free")
+        largest = series("heap_largest_block")
+        underruns = series("underruns")
+        device = {
+            "samples": len(samples),
+            "heap_free_first": heap[0] if heap else None,
+            "heap_free_last": heap[-1] if heap else None,
+            "heap_free_min": min(heap) if heap else None,
+            "heap_drift_bytes": heap[-1] - heap[0] if heap else None,
+            "heap_largest_block_min": min(largest) if largest else None,
+            "underruns_during_run": underruns[-1] - underruns[0] if underruns else None,
+        }
+
+    return {
+        "config": {
+            "mix": args.mix, "rate": args.rate, "duration_s": args.duration,
+            "concurrency": args.concurrency, "seed": args.seed,
+        },
+        "scenarios": scenarios,
+        "device": device,
+        "timeline": [{k: s[k] for k in ("t", "heap_free", "heap_largest_block", "underruns", "playing")
+                      if k in s} for s in samples],
+    }
+
+
+def compare(old_path, new_path):
+    with open(old_path) as f:
+        old = json.load(f)
+    with open(new_path) as f:
+        new = json.load(f)
+
+    print("%-14s %-10s %10s %10s %10s" % ("scenario", "metric", "old", "new", "delta"))
+    for name in sorted(set(old["scenarios"]) | set(new["scenarios"])):
+        a = old["scenarios"].get(name)
+        b = new["scenarios"].get(name)
+        if not a or not b:
+            print("%-14s only in %s" % (name, "new" if b else "old"))
+            continue
+        for metric in ("p50", "p99"):
+            x, y = a["latency_ms"][metric], b["latency_ms"][metric]
+            print("%-14s %-10s %10.1f %10.1f %+10.1f" % (name, metric + "_ms", x, y, y - x))
+        x, y = a["error_rate"], b["error_rate"]
+        print("%-14s %-10s %10.4f %10.4f %+10.4f" % (name, "errors", x, y, y - x))
+    for key in ("heap_drift_bytes", "heap_largest_block_min", "underruns_during_run"):
+        x, y = old["device"].get(key), new["device"].get(key)
+        if x is not None and y is not None:
+            print("%-14s %-10s %10d %10d %+10d" % ("device", key[:10], x, y, y - x))
+        else:
+            print("%-14s %-10s %10s %10s" % ("device", key[:10], x, y))
+
+
+# -----------------------------------------------------------------------------
+# Main
+# -----------------------------------------------------------------------------
+
+def load_wav(path, seconds):
+    if path:
+        with open(path, "rb") as f:
+            return f.read()
+    # Generated fallback: a quiet tone, so no file is needed.
+    import io
+    import math
+    buf = io.BytesIO()
+    with wave.open(buf, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(SAMPLE_RATE)
+        frames = bytearray()
+        for i in range(int(SAMPLE_RATE * seconds)):
+            v = int(3000 * math.sin(2 * math.pi * 440 * i / SAMPLE_RATE))
+            frames += v.to_bytes(2, "little", signed=True)
+        w.writeframes(bytes(frames))
+    return buf.getvalue()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", help="node address")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--duration", type=float, default=60, help="seconds")
+    parser.add_argument("--rate", type=float, default=1.0, help="requests per second (Poisson)")
+    parser.add_argument("--concurrency", type=int, default=4, help="max requests in flight")
+    parser.add_argument("--mix", default=DEFAULT_MIX, help="scenario=weight,...")
+    parser.add_argument("--files", help="comma-separated clips for play (default: from /list)")
+    parser.add_argument("--stream-wav", help="WAV file to upload (default: generated 2 s tone)")
+    parser.add_argument("--sample-interval", type=float, default=5.0, help="/status poll period, s")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--report", help="write the JSON report here")
+    parser.add_argument("--compare", nargs=2, metavar=("OLD", "NEW"), help="diff two reports")
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return
+
+    if not args.host:
+        parser.error("--host is required unless --compare is given")
+
+    target = Target(args.host, args.port, load_wav(args.stream_wav, 2.0), [])
+    if args.files:
+        target.files = args.files.split(",")
+    else:
+        status, body = target.get("/list")
+        target.files = [n.lstrip("/") for n in json.loads(body) if n.endswith(".wav")] if status == 200 else []
+    if not target.files:
+        raise SystemExit("no .wav files to play; pass --files")
+
+    rec = run(args, target)
+    report = summarize(rec, args)
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.report:
+        with open(args.report, "w") as f:
+            f.write(text + "\n")
+
+    for name, s in report["scenarios"].items():
+        print("%-12s n=%-5d ok=%-5d p50=%7.1f p99=%7.1f ms  %s"
+              % (name, s["count"], s["ok"], s["latency_ms"]["p50"], s["latency_ms"]["p99"],
+                 s["outcomes"]))
+    if report["device"]:
+        print("device: %s" % json.dumps(report["device"], sort_keys=True))
+
+
+if __name__ == "__main__":
+    main()
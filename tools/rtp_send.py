@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""Send a WAV file to a node as RTP packets, with optional network impairment.
+
+Device mode asks the node to listen (/rtp/start) and sends the clip in real
+time. Afterwards it reads /rtp/stats and reports loss, concealment and
+playout delay. End-to-end latency is estimated as half the HTTP round trip
+plus the device's playout delay.
+
+Loopback mode runs the same jitter-buffer algorithm as the firmware
+(src/rtp_receiver.cpp) in a local thread. It measures, per packet, the time
+from send to playout under the chosen impairment. Use it to pick buffer
+sizes without hardware.
+
+Usage:
+    python tools/rtp_send.py data/output.wav --host 192.168.1.63 --loss 0.05 --reorder 0.02
+    python tools/rtp_send.py data/output.wav --loopback --loss 0.1 --jitter-ms 20
+"""
+
+import argparse
+import heapq
+import json
+import random
+import socket
+import statistics
+import struct
+import threading
+import time
+import urllib.request
+import wave
+
+PAYLOAD_TYPE = 96
+SAMPLE_RATE = 22050
+FRAMES = 256                 # RTP_MAX_FRAMES
+SLOTS = 16                   # RTP_JITTER_SLOTS
+PREBUFFER = 4                # RTP_PREBUFFER_PACKETS
+PACKET_S = FRAMES / SAMPLE_RATE
+
+
+def read_pcm(path):
+    with wave.open(path, "rb") as w:
+        if w.getnchannels() != 1 or w.getsampwidth() != 2 or w.getframerate() != SAMPLE_RATE:
+            raise SystemExit("need mono 16-bit %d Hz WAV" % SAMPLE_RATE)
+        return w.readframes(w.getnframes())
+
+
+def packets(pcm, ssrc):
+    step = FRAMES * 2
+    for seq, pos in enumerate(range(0, len(pcm), step)):
+        header = struct.pack(">BBHII", 0x80, PAYLOAD_TYPE, seq & 0xFFFF,
+                             (seq * FRAMES) & 0xFFFFFFFF, ssrc)
+        yield seq, header + pcm[pos:pos + step]
+
+
+def send_impaired(sock, addr, pcm, loss, reorder, jitter_ms, sent_at=None):
+    """Send packets in real time; returns (sent, dropped)."""
+    rng = random.Random(1)
+    start = time.perf_counter()
+    pending = []  # (due, seq, data)
+    sent = dropped = 0
+
+    for seq, data in packets(pcm, rng.getrandbits(32)):
+        due = start + seq * PACKET_S
+        if rng.random() < loss:
+            dropped += 1
+            continue
+        delay = rng.uniform(0, jitter_ms / 1000.0)
+        if rng.random() < reorder:
+            delay += 2 * PACKET_S
+        heapq.heappush(pending, (due + delay, seq, data))
+
+        while pending and pending[0][0] <= due:
+            when, s, d = heapq.heappop(pending)
+            time.sleep(max(0.0, when - time.perf_counter()))
+            sock.sendto(d, addr)
+            if sent_at is not None:
+                sent_at[s] = start + s * PACKET_S
+            sent += 1
+
+    while pending:
+        when, s, d = heapq.heappop(pending)
+        time.sleep(max(0.0, when - time.perf_counter()))
+        sock.sendto(d, addr)
+        if sent_at is not None:
+            sent_at[s] = start + s * PACKET_S
+        sent += 1
+    return sent, dropped
+
+
+class LoopbackReceiver(threading.Thread):
+    """Python model of rtp_receiver.cpp, played out at the sample clock."""
+
+    def __init__(self, sock, total):
+        super().__init__(daemon=True)
+        self.sock = sock
+        self.total = total
+        self.slots = {}
+        self.lock = threading.Lock()
+        self.play_seq = None
+        self.playout = {}
+        self.concealed = 0
+        self.late = 0
+
+    def receive(self):
+        while True:
+            try:
+                data, _ = self.sock.recvfrom(2048)
+            except OSError:
+                return
+            seq = struct.unpack_from(">H", data, 2)[0]
+            with self.lock:
+                if self.play_seq is None:
+                    self.play_seq = seq
+                if seq < self.play_seq:
+                    self.late += 1
+                elif seq - self.play_seq < SLOTS:
+                    self.slots[seq] = data
+
+    def run(self):
+        threading.Thread(target=self.receive, daemon=True).start()
+        while True:
+            with self.lock:
+                if len(self.slots) >= PREBUFFER:
+                    break
+            time.sleep(0.001)
+
+        next_tick = time.perf_counter()
+        while True:
+            with self.lock:
+                seq = self.play_seq
+                if seq >= self.total:
+                    return
+                if self.slots.pop(seq, None) is not None:
+                    self.playout[seq] = time.perf_counter()
+                else:
+                    self.concealed += 1
+                self.play_seq += 1
+            next_tick += PACKET_S
+            time.sleep(max(0.0, next_tick - time.perf_counter()))
+
+
+def run_loopback(args, pcm):
+    total = (len(pcm) + FRAMES * 2 - 1) // (FRAMES * 2)
+    rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rx.bind(("127.0.0.1", 0))
+    receiver = LoopbackReceiver(rx, total)
+    receiver.start()
+
+    tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sent_at = {}
+    sent, dropped = send_impaired(tx, rx.getsockname(), pcm, args.loss, args.reorder,
+                                  args.jitter_ms, sent_at)
+    receiver.join(timeout=total * PACKET_S + 2)
+    rx.close()
+
+    latency = [(receiver.playout[s] - sent_at[s]) * 1000 for s in receiver.playout if s in sent_at]
+    print("packets %d, dropped %d, late %d, concealed %d (%.1f%%)"
+          % (total, dropped, receiver.late, receiver.concealed,
+             100.0 * receiver.concealed / max(1, total)))
+    if latency:
+        print("send->playout latency: mean %.1f  max %.1f ms (+ device DMA queue)"
+              % (statistics.mean(latency), max(latency)))
+
+
+def http_json(host, path):
+    with urllib.request.urlopen("http://%s%s" % (host, path), timeout=10) as resp:
+        return json.loads(resp.read())
+
+
+def run_device(args, pcm):
+    t0 = time.perf_counter()
+    info = http_json(args.host, "/rtp/start?port=%d" % args.port)
+    rtt_ms = (time.perf_counter() - t0) * 1000
+    print("node listening: %s" % info)
+
+    tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sent, dropped = send_impaired(tx, (args.host, info["port"]), pcm, args.loss,
+                                  args.reorder, args.jitter_ms)
+    stats = http_json(args.host, "/rtp/stats")
+    time.sleep(0.5)
+    urllib.request.urlopen("http://%s/rtp/stop" % args.host, timeout=10).read()
+
+    print("sent %d, dropped on purpose %d" % (sent, dropped))
+    print("device: %s" % json.dumps(stats))
+    print("estimated end-to-end latency: %.1f ms (rtt/2 %.1f + playout %.1f)"
+          % (rtt_ms / 2 + stats["playout_delay_ms"], rtt_ms / 2, stats["playout_delay_ms"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("wav", help="mono 16-bit 22050 Hz WAV")
+    parser.add_argument("--host", help="node address")
+    parser.add_argument("--port", type=int, default=5004)
+    parser.add_argument("--loss", type=float, default=0.0, help="drop probability")
+    parser.add_argument("--reorder", type=float, default=0.0, help="reorder probability")
+    parser.add_argument("--jitter-ms", type=float, default=0.0, help="max extra delay")
+    parser.add_argument("--loopback", action="store_true", help="run against a local model")
+    args = parser.parse_args()
+
+    pcm = read_pcm(args.wav)
+    if args.loopback:
+        run_loopback(args, pcm)
+    elif args.host:
+        run_device(args, pcm)
+    else:
+        parser.error("--host is required unless --loopback is given")
+
+
+if __name__ == "__main__":
+    main()
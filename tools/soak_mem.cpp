@@ -0,0 +1,421 @@
+// Host fragmentation soak for the memory pool (src/mem_pool.cpp), the
+// streamed LittleFS playback in src/audio_player.cpp and the batch, sprite
+// and tone paths in src/commands.cpp, src/sprites.cpp and src/tones.cpp, on
+// the shim in tools/host/.
+//
+// Runs 100k plays of LittleFS clips (short, ranged, and longer than the old
+// 2.2 s clip buffer) mixed with bank clips, sprite lookups and JSON batches
+// that play sprites, files and tones, while a second thread takes and
+// returns pool blocks the way /batch bodies do. Every --check plays the
+// player is stopped and the pool and host heap are sampled; the heap in
+// use, the number of live C++ allocations and the heap size must not move
+// from the first sample. Every --full plays a long clip runs to its end, which must deliver
+// all of its frames. No play may fail or be refused for lack of blocks, and
+// at the end no block or file may be left open.
+//
+//   g++ -O2 -std=gnu++17 -pthread -Itools/host -Iinclude -o soak_mem tools/soak_mem.cpp
+//       tools/host/host_shim.cpp src/audio_player.cpp src/mem_pool.cpp src/tone_synth.cpp
+//       src/commands.cpp src/sprites.cpp src/tones.cpp
+//   ./soak_mem [--plays 100000] [--check 10000] [--full 5000] [--speed 200] [--seed 1]
+//
+// --speed runs the virtual clock that many times faster than real time; far
+// above 20x the host itself falls behind the I2S model, so underruns are
+// printed but not checked. The host heap is glibc's, not the ESP32's, so
+// read it as "playback does not allocate", not as a fragmentation figure for
+// the device; mem_get_stats() covers the pool itself. ArduinoJson is the
+// host stand-in in tools/host/, which allocates through the same Allocator.
+
+#include "audio_player.h"
+#include "commands.h"
+#include "control.h"
+#include "mem_pool.h"
+#include "sprites.h"
+#include "tones.h"
+#include "sound_bank.h"
+#include "rtp_receiver.h"
+#include "clock_sync.h"
+#include "energy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Result = AudioPlayer::Result;
+
+static constexpr int AMP_PIN = 5;
+static constexpr uint32_t RATE = AudioPlayer::SAMPLE_RATE;
+
+// -----------------------------------------------------------------------------
+// Stubs for the modules the player calls into
+// -----------------------------------------------------------------------------
+
+static int16_t bankPcm[RATE / 2];
+
+bool sound_bank_find(const char* name, SoundBankClip* clip) {
+    if (strcmp(name, "bank") != 0) return false;
+    clip->name = "bank";
+    clip->data = (const uint8_t*)bankPcm;
+    clip->size = sizeof(bankPcm);
+    return true;
+}
+
+bool rtp_receiver_begin(uint16_t port) { return port != 0; }
+void rtp_receiver_end() {}
+
+RtpPull rtp_receiver_pull(int16_t* out, size_t* frames) {
+    memset(out, 0, RTP_MAX_FRAMES * sizeof(int16_t));
+    *frames = RTP_MAX_FRAMES;
+    return RtpPull::Buffering;
+}
+
+int64_t clock_sync_now_us() { return esp_timer_get_time(); }
+bool clock_sync_start_time(uint64_t, int64_t*) { return false; }
+
+size_t control_status_json(char* out, size_t len) { return snprintf(out, len, "{\"playing\":false}"); }
+size_t control_battery_json(char* out, size_t len) { return snprintf(out, len, "{\"voltage\":3.90}"); }
+size_t control_sleep_json(char* out, size_t len) { return snprintf(out, len, "{\"night_now\":false}"); }
+
+void energy_set(EnergyFlag, bool) {}
+void energy_add_amp(uint32_t, uint64_t) {}
+
+// -----------------------------------------------------------------------------
+// Allocation count
+// -----------------------------------------------------------------------------
+
+static std::atomic<int64_t> liveAllocs{0};
+
+void* operator new(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    liveAllocs++;
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    liveAllocs--;
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+// -----------------------------------------------------------------------------
+// Test clips
+// -----------------------------------------------------------------------------
+
+static void write_wav(const std::string& path, size_t frames, float hz) {
+    std::vector<int16_t> pcm(frames);
+    for (size_t i = 0; i < frames; i++) pcm[i] = (int16_t)(20000 * sinf(2 * (float)M_PI * hz * i / RATE));
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        exit(2);
+    }
+    uint32_t dataBytes = frames * sizeof(int16_t);
+    uint32_t riffSize = 36 + dataBytes;
+    uint32_t fmtSize = 16, rate = RATE, byteRate = RATE * 2;
+    uint16_t format = 1, channels = 1, align = 2, bits = 16;
+
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&riffSize, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    fwrite(&fmtSize, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);
+    fwrite(&byteRate, 4, 1, f);
+    fwrite(&align, 2, 1, f);
+    fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    fwrite(&dataBytes, 4, 1, f);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), f);
+    fclose(f);
+}
+
+struct Clip {
+    const char* path;
+    size_t frames;
+};
+
+// The long clip is 6 s, well past the 96 KB (2.2 s) buffer it replaced.
+static const Clip CLIPS[] = {
+    {"/clips/short.wav", RATE / 5},
+    {"/clips/mid.wav", RATE},
+    {"/clips/long.wav", RATE * 6},
+};
+static constexpr int LONG_CLIP = 2;
+
+static void write_text(const std::string& path, const char* text) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f || fputs(text, f) < 0) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        exit(2);
+    }
+    fclose(f);
+}
+
+static const char* const SPRITES[] = {"chirp", "knock", "tail"};
+
+static void make_clips(const std::string& root) {
+    mkdir((root + "/clips").c_str(), 0755);
+    for (const Clip& c : CLIPS) write_wav(root + c.path, c.frames, 440);
+    for (size_t i = 0; i < sizeof(bankPcm) / sizeof(bankPcm[0]); i++) bankPcm[i] = (int16_t)(i * 37);
+
+    write_text(root + SPRITE_MANIFEST_PATH,
+               "{\n"
+               "  \"chirp\": { \"file\": \"clips/mid.wav\", \"start_ms\": 120, \"end_ms\": 450 },\n"
+               "  \"knock\": { \"bank\": \"bank\", \"start\": 2205, \"end\": 6615 },\n"
+               "  \"tail\": { \"file\": \"/clips/long.wav\", \"start_ms\": 5000 }\n"
+               "}\n");
+    write_text(root + "/beep" TONE_FILE_EXT,
+               "{\"wave\":\"triangle\",\"adsr\":[2,30,0.6,40],\"notes\":[[\"E6\",60],[\"C6\",90,0.8]]}");
+}
+
+// -----------------------------------------------------------------------------
+// Soak
+// -----------------------------------------------------------------------------
+
+static AudioPlayer* player; // created in main(), after Serial is quiet
+static std::atomic<uint32_t> failures{0};
+static std::atomic<bool> finished{false};
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Stands in for /batch: grabs as many blocks as the pool hands out and
+// returns them in a shuffled order, so the playback pair is carved out of a
+// changing bitmap and request bodies can never take it.
+static void batch_churn(unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<void*> held;
+    size_t maxHeld = 0;
+
+    while (!finished) {
+        if (rng() % 2) {
+            void* b = mem_block_alloc();
+            if (b) held.push_back(b);
+            maxHeld = std::max(maxHeld, held.size());
+        } else if (!held.empty()) {
+            size_t i = rng() % held.size();
+            mem_block_free(held[i]);
+            held[i] = held.back();
+            held.pop_back();
+        }
+        std::this_thread::yield();
+    }
+    for (void* b : held) mem_block_free(b);
+    expect(maxHeld == MEM_BLOCK_COUNT - 2, "request bodies leave the playback pair");
+}
+
+// The /batch and /ws text path, run the way the AsyncTCP task runs it. The
+// last body is over CONTROL_BATCH_MAX_COMMANDS and must be refused unparsed.
+static const char* const BATCHES[] = {
+    "[{\"cmd\":\"play\",\"sprite\":\"chirp\"},{\"cmd\":\"status\"}]",
+    "[{\"cmd\":\"stop\"},{\"cmd\":\"play\",\"file\":\"clips/mid.wav\",\"start\":100,\"end\":400}]",
+    "[{\"cmd\":\"play\",\"tone\":\"beep\"},{\"cmd\":\"ping\"},{\"cmd\":\"volume\",\"value\":0.8}]",
+    "[{\"cmd\":\"play\",\"tone\":{\"wave\":\"square\",\"adsr\":[2,20,0.5,30],"
+    "\"notes\":[[\"A5\",40],[0,10],[880,40,0.5]]}},{\"cmd\":\"battery\"}]",
+    "[{\"cmd\":\"play\",\"sprite\":\"knock\"},{\"cmd\":\"sleep\"},{\"cmd\":\"play\",\"sprite\":\"tail\"}]",
+    "[{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},"
+    "{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},"
+    "{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},{\"cmd\":\"ping\"},"
+    "{\"cmd\":\"ping\"},{\"cmd\":\"ping\"}]",
+};
+static constexpr int OVERSIZED_BATCH = 5;
+
+// Runs one batch and folds its results into a play result: Failed if any
+// command failed outright, Busy if any was busy or skipped.
+static Result run_batch(int which) {
+    static char reply[CONTROL_BATCH_MAX_RESPONSE];
+    const char* body = BATCHES[which];
+    int status = commands_run_batch(body, strlen(body), reply, sizeof(reply));
+    if (which == OVERSIZED_BATCH) {
+        expect(status == 413, "oversized batch refused");
+        return status == 413 ? Result::Ok : Result::Failed;
+    }
+    expect(status == 200, "batch accepted");
+    if (status != 200) return Result::Failed;
+
+    Result r = Result::Ok;
+    for (const char* p = strstr(reply, "\"ok\":false"); p; p = strstr(p + 1, "\"ok\":false")) {
+        const char* rest = p + strlen("\"ok\":false");
+        if (strncmp(rest, ",\"error\"", 8) != 0) {
+            fprintf(stderr, "batch %d: %s\n", which, reply);
+            return Result::Failed;
+        }
+        r = Result::Busy;
+    }
+    return r;
+}
+
+static void check_sprites() {
+    Sprite sprite;
+    for (const char* name : SPRITES) expect(sprite_lookup(name, &sprite), "sprite found");
+    expect(!sprite_lookup("missing", &sprite), "unknown sprite not found");
+}
+
+// Plays the long clip to its end and checks that every frame reached I2S.
+static void full_play() {
+    uint64_t before = host::i2s_stats().frames_written;
+    expect(player->playFile(CLIPS[LONG_CLIP].path) == Result::Ok, "full play accepted");
+    while (player->isPlaying()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    uint64_t written = host::i2s_stats().frames_written - before;
+    expect(written >= CLIPS[LONG_CLIP].frames, "long clip played to the end");
+}
+
+struct Sample {
+    int64_t live;
+    size_t inUse;
+    size_t arena;
+};
+
+static Sample sample_heap() {
+    expect(player->stop() == Result::Ok, "stop at checkpoint");
+    struct mallinfo2 mi = mallinfo2();
+    return {liveAllocs.load(), mi.uordblks, mi.arena};
+}
+
+int main(int argc, char** argv) {
+    int plays = 100000;
+    int check = 10000;
+    int full = 5000;
+    double speed = 200;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--plays") && i + 1 < argc) plays = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--check") && i + 1 < argc) check = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--full") && i + 1 < argc) full = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--speed") && i + 1 < argc) speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned)atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--plays N] [--check N] [--full N] [--speed X] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (check <= 0 || full <= 0) {
+        fprintf(stderr, "--check and --full must be positive\n");
+        return 2;
+    }
+
+    // One malloc arena, so mallinfo2() sees every thread's allocations.
+    mallopt(M_ARENA_MAX, 1);
+
+    char root[] = "/tmp/soak_mem.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    make_clips(root);
+    host::set_fs_root(root);
+    host::set_quiet(true);
+    host::set_speed(speed);
+
+    mem_pool_init();
+    expect(sprites_init() == sizeof(SPRITES) / sizeof(SPRITES[0]), "sprite manifest loaded");
+    player = new AudioPlayer(26, 25, 22, AMP_PIN, true);
+    if (!player->begin()) return 1;
+    commands_init(*player);
+
+    printf("%d plays at %.0fx speed, seed %u, checkpoint every %d\n", plays, speed, seed, check);
+    fflush(stdout);
+
+    // One play to the end and one pass over every batch first create
+    // whatever the shim builds lazily.
+    full_play();
+    for (int b = 0; b < (int)(sizeof(BATCHES) / sizeof(BATCHES[0])); b++) run_batch(b);
+    expect(player->stop() == Result::Ok, "stop after warm-up");
+    // Only sprites_init() may parse on the heap.
+    size_t jsonHeapAllocs = host_json::heap_allocations();
+
+    std::thread batch(batch_churn, seed + 1);
+    std::mt19937 rng(seed);
+    uint32_t counts[3] = {};
+    std::vector<Sample> samples;
+    samples.reserve(plays / check); // growing it would show up in the samples
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (int i = 1; i <= plays; i++) {
+        Result r;
+        if (i % full == 0) {
+            full_play();
+            r = Result::Ok;
+        } else if (rng() % 8 == 0) {
+            r = player->playBank("bank");
+        } else if (rng() % 4 == 0) {
+            check_sprites();
+            r = run_batch(rng() % (sizeof(BATCHES) / sizeof(BATCHES[0])));
+        } else {
+            const Clip& clip = CLIPS[rng() % 3];
+            AudioPlayer::PlayRange range;
+            if (rng() % 2) {
+                range.startFrame = rng() % (clip.frames / 2);
+                range.endFrame = range.startFrame + 1 + rng() % (clip.frames / 2);
+            }
+            r = player->playFile(clip.path, range);
+        }
+        counts[(int)r]++;
+        // Let some plays cross a block boundary or two before the next one.
+        if (rng() % 4 == 0) vTaskDelay(rng() % 120);
+
+        if (i % check == 0) {
+            Sample s = sample_heap();
+            MemStats m = mem_get_stats();
+            samples.push_back(s);
+            printf("%7d plays: live allocations %lld, heap in use %zu, heap size %zu, blocks peak %u, "
+                   "play_rejects %lu\n",
+                   i, (long long)s.live, s.inUse, s.arena, m.blocks_peak, (unsigned long)m.play_rejects);
+            fflush(stdout);
+        }
+    }
+
+    finished = true;
+    batch.join();
+    expect(player->stop() == Result::Ok, "final stop");
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    MemStats m = mem_get_stats();
+    host::I2sStats s = host::i2s_stats();
+    printf("soak: %d plays in %.1f s: ok=%u failed=%u busy=%u\n", plays, seconds, counts[0], counts[1], counts[2]);
+    printf("pool: blocks_in_use=%u blocks_peak=%u/%d block_failures=%lu play_rejects=%lu open_files=%d\n",
+           m.blocks_in_use, m.blocks_peak, MEM_BLOCK_COUNT, (unsigned long)m.block_failures,
+           (unsigned long)m.play_rejects, host::open_files());
+    printf("i2s: installs=%u frames=%llu write_errors=%u underruns=%lu\n", s.installs,
+           (unsigned long long)s.frames_written, s.write_errors, (unsigned long)player->underruns());
+
+    // Busy only means the host fell behind the virtual clock for a moment.
+    expect(counts[(int)Result::Failed] == 0, "no play failed");
+    expect(m.blocks_in_use == 0, "no pool blocks in use");
+    expect(m.play_rejects == 0, "no play refused for lack of blocks");
+    expect(host::open_files() == 0, "no open files");
+    expect(s.write_errors == 0, "no writes to an uninstalled driver");
+    expect(host_json::heap_allocations() == jsonHeapAllocs, "batches, sprites and tones parse without the heap");
+    for (size_t i = 1; i < samples.size(); i++) {
+        expect(samples[i].live == samples[0].live, "live allocations flat");
+        expect(samples[i].inUse == samples[0].inUse, "host heap in use flat");
+        expect(samples[i].arena == samples[0].arena, "host heap size flat");
+    }
+
+    std::string cleanup = std::string("rm -rf ") + root;
+    if (system(cleanup.c_str()) != 0) fprintf(stderr, "could not remove %s\n", root);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    fflush(stdout);
+    // The player task never returns; leave without running destructors
+    // under it.
+    _exit(failures ? 1 : 0);
+}
@@ -0,0 +1,39 @@
+# PlatformIO extra script: adds `pio run -t uploadbank`, which packs data/*.wav
+# into a sound bank image and flashes it to the "soundbank" partition.
+
+import csv
+import os
+
+Import("env")  # noqa: F821 (provided by PlatformIO)
+
+project_dir = env.subst("$PROJECT_DIR")
+build_dir = env.subst("$BUILD_DIR")
+builder = os.path.join(project_dir, "tools", "build_soundbank.py")
+bank_image = os.path.join(build_dir, "soundbank.bin")
+
+
+def find_partition(name):
+    table = os.path.join(project_dir, env.GetProjectOption("board_build.partitions"))
+    with open(table) as f:
+        rows = csv.reader(line for line in f if not line.lstrip().startswith("#"))
+        for row in rows:
+            row = [c.strip() for c in row]
+            if row and row[0] == name:
+                return row[3], row[4]
+    raise ValueError("partition '%s' not found in %s" % (name, table))
+
+
+offset, size = find_partition("soundbank")
+
+env.AddCustomTarget(
+    name="uploadbank",
+    dependencies=None,
+    actions=[
+        '"$PYTHONEXE" "%s" "%s" "%s" --max-size %s'
+        % (builder, os.path.join(project_dir, "data"), bank_image, size),
+        '"$PYTHONEXE" "$UPLOADER" --chip $BOARD_MCU --port "$UPLOAD_PORT" '
+        '--baud $UPLOAD_SPEED write_flash %s "%s"' % (offset, bank_image),
+    ],
+    title="Upload Sound Bank",
+    description="Pack data/*.wav and flash it to the soundbank partition",
+)
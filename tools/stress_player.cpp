@@ -0,0 +1,448 @@
+// Host stress test for the AudioPlayer command state machine
+// (src/audio_player.cpp) on the FreeRTOS/I2S/LittleFS shim in tools/host/.
+//
+// Several client threads stand in for the AsyncTCP task and loop() and fire
+// thousands of interleaved play, stop, stream, tone, RTP and volume commands
+// at one player, while another holds the flash-write gate the way the
+// transcoder does and checks that nothing starts under it. A watchdog fails the run if no command completes for
+// --watchdog seconds (a deadlock). A stall phase then wedges i2s_write and
+// checks that callers get Busy within SUBMIT_TIMEOUT_MS, that an abandoned
+// command never runs, and that the player recovers. At the end the player
+// must be idle with the amp off, I2S uninstalled, no open files, no pool
+// blocks in use, no host heap growth, and no sample read from a stream
+// buffer after streamUploadWrite() returned.
+//
+//   g++ -O2 -std=gnu++17 -pthread -Itools/host -Iinclude -o stress_player tools/stress_player.cpp
+//       tools/host/host_shim.cpp src/audio_player.cpp src/mem_pool.cpp src/tone_synth.cpp
+//   ./stress_player [--commands 6000] [--clients 3] [--speed 20] [--seed 1] [--watchdog 10]
+//
+// --speed runs the virtual clock (and so the I2S sample clock and every
+// FreeRTOS timeout) that many times faster than real time.
+
+#include "audio_player.h"
+#include "mem_pool.h"
+#include "sound_bank.h"
+#include "rtp_receiver.h"
+#include "clock_sync.h"
+#include "energy.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Result = AudioPlayer::Result;
+
+static constexpr int AMP_PIN = 5;
+static constexpr uint32_t RATE = AudioPlayer::SAMPLE_RATE;
+
+// -----------------------------------------------------------------------------
+// Stubs for the modules the player calls into
+// -----------------------------------------------------------------------------
+
+static int16_t bankPcm[RATE / 2];
+
+bool sound_bank_find(const char* name, SoundBankClip* clip) {
+    if (strcmp(name, "bank") != 0) return false;
+    clip->name = "bank";
+    clip->data = (const uint8_t*)bankPcm;
+    clip->size = sizeof(bankPcm);
+    return true;
+}
+
+bool rtp_receiver_begin(uint16_t port) { return port != 0; }
+void rtp_receiver_end() {}
+
+RtpPull rtp_receiver_pull(int16_t* out, size_t* frames) {
+    memset(out, 0, RTP_MAX_FRAMES * sizeof(int16_t));
+    *frames = RTP_MAX_FRAMES;
+    return RtpPull::Buffering;
+}
+
+int64_t clock_sync_now_us() { return esp_timer_get_time(); }
+
+void energy_set(EnergyFlag, bool) {}
+void energy_add_amp(uint32_t, uint64_t) {}
+
+// -----------------------------------------------------------------------------
+// Test clips
+// -----------------------------------------------------------------------------
+
+// Peak 20000 keeps every sample clear of host::POISON_SAMPLE.
+static void fill_sine(int16_t* pcm, size_t frames, float hz) {
+    for (size_t i = 0; i < frames; i++) {
+        pcm[i] = (int16_t)(20000 * sinf(2 * (float)M_PI * hz * i / RATE));
+    }
+}
+
+static void write_wav(const std::string& path, size_t frames, float hz) {
+    std::vector<int16_t> pcm(frames);
+    fill_sine(pcm.data(), frames, hz);
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        exit(2);
+    }
+    uint32_t dataBytes = frames * sizeof(int16_t);
+    uint32_t riffSize = 36 + dataBytes;
+    uint32_t fmtSize = 16, rate = RATE, byteRate = RATE * 2;
+    uint16_t format = 1, channels = 1, align = 2, bits = 16;
+
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&riffSize, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f);
+    fwrite(&fmtSize, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f);
+    fwrite(&byteRate, 4, 1, f);
+    fwrite(&align, 2, 1, f);
+    fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    fwrite(&dataBytes, 4, 1, f);
+    fwrite(pcm.data(), sizeof(int16_t), pcm.size(), f);
+    fclose(f);
+}
+
+static const char* const CLIPS[] = {"/clips/short.wav", "/clips/mid.wav", "/clips/long.wav"};
+
+static void make_clips(const std::string& root) {
+    mkdir((root + "/clips").c_str(), 0755);
+    write_wav(root + CLIPS[0], RATE / 5, 440);
+    write_wav(root + CLIPS[1], RATE, 660);
+    write_wav(root + CLIPS[2], RATE * 2, 880);
+    fill_sine(bankPcm, sizeof(bankPcm) / sizeof(bankPcm[0]), 550);
+}
+
+// -----------------------------------------------------------------------------
+// Clients
+// -----------------------------------------------------------------------------
+
+static AudioPlayer* player; // created in main(), after Serial is quiet
+static std::atomic<uint64_t> progress{0};
+static std::atomic<uint32_t> counts[3];     // by Result
+static std::atomic<uint32_t> failures{0};
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void record(Result r) {
+    counts[(int)r]++;
+    progress++;
+}
+
+static TonePatch short_tone() {
+    TonePatch p;
+    p.count = 2;
+    p.notes[0] = {880, 60, 255};
+    p.notes[1] = {0, 20, 0};
+    return p;
+}
+
+// Start, a few writes, then end or abort. The buffer is poisoned as soon as
+// each write returns; the player must not read it afterwards.
+static void stream_session(std::mt19937& rng) {
+    std::vector<int16_t> buf(1024);
+    record(player->streamUploadStart(44 + buf.size() * 4));
+    int writes = 1 + rng() % 4;
+    for (int i = 0; i < writes; i++) {
+        size_t frames = 64 + rng() % (buf.size() - 64);
+        fill_sine(buf.data(), frames, 330);
+        record(player->streamUploadWrite((const uint8_t*)buf.data(), frames * sizeof(int16_t)));
+        std::fill(buf.begin(), buf.end(), host::POISON_SAMPLE);
+    }
+    record(rng() % 4 ? player->streamUploadEnd() : player->streamUploadAbort());
+}
+
+static void client_commands(std::mt19937& rng, int commands) {
+    TonePatch tone = short_tone();
+
+    for (int i = 0; i < commands; i++) {
+        switch (rng() % 10) {
+            case 0:
+            case 1: {
+                AudioPlayer::PlayRange range;
+                if (rng() % 2) {
+                    range.startFrame = rng() % 2000;
+                    range.endFrame = range.startFrame + 1 + rng() % 4000;
+                }
+                record(player->playFile(CLIPS[rng() % 3], range));
+                break;
+            }
+            case 2:
+                record(player->playFile(CLIPS[rng() % 3], AudioPlayer::PlayRange(),
+                                       clock_sync_now_us() + (int64_t)(rng() % 150) * 1000));
+                break;
+            case 3:
+                record(player->playBank(rng() % 8 ? "bank" : "missing"));
+                break;
+            case 4:
+                record(player->playTone(tone));
+                break;
+            case 5:
+            case 6:
+                record(player->stop());
+                break;
+            case 7:
+                stream_session(rng);
+                break;
+            case 8:
+                record(rng() % 2 ? player->playRandom("/clips") : player->playRtp(5004));
+                break;
+            case 9:
+                player->setVolume((rng() % 101) / 100.0f);
+                progress++;
+                break;
+        }
+        if (rng() % 4 == 0) vTaskDelay(rng() % 30);
+    }
+}
+
+// Clients meet here halfway and at the end, while main() stops the player
+// and reads the heap with every thread still alive.
+static struct {
+    std::mutex lock;
+    std::condition_variable changed;
+    int arrived = 0;
+    int released = 0;
+} meeting;
+
+static void meet(int point) {
+    std::unique_lock<std::mutex> lock(meeting.lock);
+    meeting.arrived++;
+    meeting.changed.notify_all();
+    meeting.changed.wait(lock, [&] { return meeting.released >= point; });
+}
+
+// Waits for `clients` arrivals in total, stops the player and returns the
+// heap in use; release() lets the clients go on.
+static size_t gather(int clients) {
+    {
+        std::unique_lock<std::mutex> lock(meeting.lock);
+        meeting.changed.wait(lock, [&] { return meeting.arrived == clients; });
+    }
+    expect(player->stop() == Result::Ok, "stop at meeting");
+    return mallinfo2().uordblks;
+}
+
+static void release() {
+    std::lock_guard<std::mutex> lock(meeting.lock);
+    meeting.released++;
+    meeting.changed.notify_all();
+}
+
+static void client(unsigned seed, int commands) {
+    std::mt19937 rng(seed);
+    client_commands(rng, commands / 2);
+    meet(1);
+    client_commands(rng, commands - commands / 2);
+    meet(2);
+}
+
+static std::atomic<bool> finished{false};
+
+static void watchdog(double seconds) {
+    uint64_t last = progress;
+    auto lastChange = std::chrono::steady_clock::now();
+    while (!finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        uint64_t now = progress;
+        if (now != last) {
+            last = now;
+            lastChange = std::chrono::steady_clock::now();
+        } else if (std::chrono::steady_clock::now() - lastChange > std::chrono::duration<double>(seconds)) {
+            fprintf(stderr, "FAIL: no command completed for %.0f s (deadlock?) after %llu\n",
+                    seconds, (unsigned long long)now);
+            fflush(stderr);
+            _exit(1);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Phases
+// -----------------------------------------------------------------------------
+
+// Virtual milliseconds as a real duration.
+static std::chrono::microseconds real_ms(uint32_t ms) {
+    return std::chrono::microseconds((int64_t)(ms * 1000 / host::speed()));
+}
+
+// Stands in for the transcoder: holds the flash gate the way one flash write
+// does and checks that no source started under it.
+static std::atomic<bool> writerStop{false};
+static std::atomic<uint32_t> flashWrites{0};
+
+static void flash_writer() {
+    while (!writerStop) {
+        if (player->beginFlashWrite()) {
+            std::this_thread::sleep_for(real_ms(5));
+            expect(!player->isPlaying() && !player->isStreaming() && !player->isRtpActive(),
+                   "no source starts during a flash write");
+            player->endFlashWrite();
+            flashWrites++;
+        }
+        std::this_thread::sleep_for(real_ms(2));
+    }
+}
+
+// Wedges the output so the player task sits in i2s_write well past the
+// submit timeout, then releases it.
+static void stall_phase() {
+    uint32_t rejectsBefore = player->busyRejects();
+    expect(player->playFile(CLIPS[2]) == Result::Ok, "play before stall");
+
+    // Each write now takes 4x the submit timeout.
+    uint32_t stallMs = (uint32_t)(4 * AudioPlayer::SUBMIT_TIMEOUT_MS / host::speed());
+    host::set_i2s_stall_ms(stallMs);
+    vTaskDelay(50);
+
+    int64_t t0 = host::now_us();
+    uint32_t latencyUs = 0;
+    Result r = player->stop(&latencyUs);
+    int64_t waitedMs = (host::now_us() - t0) / 1000;
+    expect(r == Result::Busy, "stop during stall is Busy");
+    expect(waitedMs < AudioPlayer::SUBMIT_TIMEOUT_MS * 3 / 2, "stop during stall is bounded");
+
+    // A second caller while the first waits: also bounded.
+    Result other = Result::Ok;
+    std::thread t([&] { other = player->playTone(short_tone()); });
+    expect(player->playBank("bank") == Result::Busy, "play during stall is Busy");
+    t.join();
+    expect(other == Result::Busy, "concurrent tone during stall is Busy");
+
+    // Wait for the write in progress to come out of its stall and for the
+    // player to see the queued commands; the clip has most of its two
+    // seconds left.
+    uint64_t framesBefore = host::i2s_stats().frames_written;
+    host::set_i2s_stall_ms(0);
+    for (uint32_t waited = 0; host::i2s_stats().frames_written == framesBefore && waited < 2 * stallMs; waited++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(real_ms(100));
+
+    // The abandoned stop and plays were dropped, so the long clip is still
+    // playing, and the next result belongs to the next command.
+    expect(player->isPlaying(), "abandoned stop did not run");
+    expect(!strcmp(player->lastSource(), "littlefs"), "abandoned plays did not run");
+    expect(player->playFile("/clips/none.wav") == Result::Failed, "no stale result after Busy");
+    expect(player->stop() == Result::Ok, "stop after recovery");
+    expect(!player->isPlaying(), "idle after recovery");
+    expect(player->busyRejects() - rejectsBefore >= 3, "busy_rejects counted");
+}
+
+static void check_idle() {
+    host::I2sStats s = host::i2s_stats();
+    MemStats m = mem_get_stats();
+
+    printf("idle: playing=%d streaming=%d rtp=%d amp_pin=%d i2s_installed=%d open_files=%d "
+           "blocks_in_use=%u\n",
+           player->isPlaying(), player->isStreaming(), player->isRtpActive(), host::gpio_level(AMP_PIN),
+           s.installed, host::open_files(), m.blocks_in_use);
+    printf("i2s: installs=%u frames=%llu write_errors=%u poison_hits=%u underruns=%lu\n",
+           s.installs, (unsigned long long)s.frames_written, s.write_errors, s.poison_hits,
+           (unsigned long)player->underruns());
+
+    expect(!player->isPlaying() && !player->isStreaming() && !player->isRtpActive(), "player idle");
+    expect(host::gpio_level(AMP_PIN) == 0, "amp off");
+    expect(!s.installed, "I2S uninstalled");
+    expect(host::open_files() == 0, "no open files");
+    expect(m.blocks_in_use == 0, "no pool blocks in use");
+    expect(s.write_errors == 0, "no writes to an uninstalled driver");
+    expect(s.poison_hits == 0, "no stream buffer read after release");
+}
+
+int main(int argc, char** argv) {
+    int commands = 6000;
+    int clients = 3;
+    double speed = 20;
+    unsigned seed = 1;
+    double watchdogSeconds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--commands") && i + 1 < argc) commands = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--clients") && i + 1 < argc) clients = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--speed") && i + 1 < argc) speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--watchdog") && i + 1 < argc) watchdogSeconds = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--commands N] [--clients N] [--speed X] [--seed N] [--watchdog S]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    // One malloc arena, so mallinfo2() sees every thread's allocations.
+    mallopt(M_ARENA_MAX, 1);
+
+    char root[] = "/tmp/stress_player.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    make_clips(root);
+    host::set_fs_root(root);
+    host::set_quiet(true);
+    host::set_speed(speed);
+
+    mem_pool_init();
+    player = new AudioPlayer(26, 25, 22, AMP_PIN, true);
+    if (!player->begin()) return 1;
+
+    // Printing first also allocates the stdout buffer before the baseline.
+    printf("%d commands from %d clients at %.0fx speed, seed %u\n", commands, clients, speed, seed);
+    fflush(stdout);
+
+    // The first half warms up lazily created host state (malloc caches and
+    // the like), so growth is measured over the second half only, with the
+    // same threads alive at both ends.
+    std::thread dog(watchdog, watchdogSeconds);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    std::thread writer(flash_writer);
+    for (int c = 0; c < clients; c++) threads.emplace_back(client, seed + c, commands / clients);
+    size_t heapBefore = gather(clients);
+    release();
+    size_t heapAfter = gather(2 * clients);
+    release();
+    for (std::thread& t : threads) t.join();
+    writerStop = true;
+    writer.join();
+
+    double mixedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("mixed: %d commands from %d clients in %.1f s: ok=%u failed=%u busy=%u, flash writes %u\n",
+           commands, clients, mixedSeconds, counts[0].load(), counts[1].load(), counts[2].load(),
+           flashWrites.load());
+    expect(flashWrites > 0, "flash writes got a turn between plays");
+
+    printf("heap: %ld bytes over the second half\n", (long)heapAfter - (long)heapBefore);
+    expect(heapAfter == heapBefore, "no host heap growth");
+
+    stall_phase();
+    check_idle();
+
+    finished = true;
+    dog.join();
+
+    std::string cleanup = std::string("rm -rf ") + root;
+    if (system(cleanup.c_str()) != 0) fprintf(stderr, "could not remove %s\n", root);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    fflush(stdout);
+    // The player task never returns; leave without running destructors
+    // under it.
+    _exit(failures ? 1 : 0);
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Start the same clip on several nodes at one instant and report start skew.
+
+Optionally points every node except the first at the first one's clock
+(/clock/sync?peer=) so that they share one reference instead of relying
+on NTP alone. The clip is scheduled --lead-ms ahead with /play?at=. Each node
+then reports its own estimated start error and the offset uncertainty
+(rtt / 2) through /status. The estimate comes from the node's DMA queue
+model, not from the output; measure the real skew with a scope or a
+microphone.
+
+Usage:
+    python tools/sync_play.py 192.168.1.63 192.168.1.64 --file alert.wav --sync
+    python tools/sync_play.py 192.168.1.63 192.168.1.64 --bank door.wav --stagger-ms 250
+"""
+
+import argparse
+import json
+import time
+import urllib.parse
+import urllib.request
+
+
+def http_json(host, path):
+    with urllib.request.urlopen("http://%s%s" % (host, path), timeout=10) as resp:
+        return json.loads(resp.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("hosts", nargs="+", help="node addresses; the first is the clock reference")
+    clip = parser.add_mutually_exclusive_group(required=True)
+    clip.add_argument("--file")
+    clip.add_argument("--bank")
+    clip.add_argument("--sprite")
+    parser.add_argument("--lead-ms", type=int, default=1500, help="schedule this far ahead")
+    parser.add_argument("--stagger-ms", type=int, default=0, help="delay each node after the previous one")
+    parser.add_argument("--sync", action="store_true", help="sync clocks to the first node first")
+    args = parser.parse_args()
+
+    if args.sync:
+        for host in args.hosts[1:]:
+            http_json(host, "/clock/sync?peer=%s" % args.hosts[0])
+            clock = http_json(host, "/clock")
+            while clock["measuring"]:
+                time.sleep(0.2)
+                clock = http_json(host, "/clock")
+            if clock["last_failed"]:
+                print("%-15s no reply from %s, keeping the previous clock" % (host, args.hosts[0]))
+                continue
+            print("%-15s offset %+8d us  rtt %6d us" % (host, clock["offset_us"], clock["rtt_us"]))
+
+    kind, name = next((k, v) for k, v in (("file", args.file), ("bank", args.bank),
+                                          ("sprite", args.sprite)) if v)
+    at = int(time.time() * 1000) + args.lead_ms
+    for i, host in enumerate(args.hosts):
+        query = urllib.parse.urlencode({kind: name, "at": at + i * args.stagger_ms})
+        print("%-15s %s" % (host, http_json(host, "/play?" + query)))
+
+    time.sleep((args.lead_ms + args.stagger_ms * len(args.hosts)) / 1000.0 + 0.2)
+    print()
+    print("%-15s %12s %14s" % ("node", "est_skew_us", "uncertainty_us"))
+    for host in args.hosts:
+        status = http_json(host, "/status")
+        print("%-15s %+12d %14d" % (host, status["estimated_start_skew_us"], status["clock_rtt_us"] // 2))
+
+
+if __name__ == "__main__":
+    main()